@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzzy.h"
+
+#if INTERFACE
+
+#define FUZZY_BEST     16              // Results kept by a fuzzy search
+
+struct hit {
+  int score;
+  int pos;                   // Start of the line
+};
+
+// The best lines so far, kept as a heap with the worst of them on top
+struct best {
+  int count;
+  struct hit hits[FUZZY_BEST];
+};
+
+#endif
+
+#define SCORE_MATCH    16
+#define BONUS_START    10              // Match at the start of the text on the line
+#define BONUS_WORD     8               // Match at the start of a word
+#define BONUS_CAMEL    7               // Match at a lowercase to uppercase change
+#define BONUS_RUN      4               // Match right after the previous one
+#define PENALTY_GAP    3               // For starting a gap between matches
+#define PENALTY_SKIP   1               // For every further character in a gap
+
+#define LOWER(c)       ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+#define WORD(c)        (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9') || (c) >= 0x80)
+
+static int bonus(const unsigned char *line, int i, int indent) {
+  int prev, ch = line[i];
+
+  // A query starting with a space or tab can match before the indent ends
+  if (i == indent || i == 0) return BONUS_START;
+  prev = line[i - 1];
+  if (!WORD(prev) && WORD(ch)) return BONUS_WORD;
+  if (prev >= 'a' && prev <= 'z' && ch >= 'A' && ch <= 'Z') return BONUS_CAMEL;
+  return 0;
+}
+
+int fuzzy_score(const char *text, int len, const char *query, int qlen) {
+ /**
+  * Scores a line against a query whose characters must all appear in it in
+  * order, ignoring case. The shortest stretch of the line holding them is
+  * found first, then matches at word starts and runs of matches score more.
+  * @return The score, or -1 if the line does not hold the query
+  */
+  const unsigned char *line = (const unsigned char *) text;
+  const unsigned char *q = (const unsigned char *) query;
+  int i, j, start, end, indent, score, last;
+
+  // The first place the whole query is found ends the shortest stretch
+  for (i = 0, j = 0; i < len && j < qlen; i++) {
+    if (LOWER(line[i]) == LOWER(q[j])) j++;
+  }
+  if (j < qlen) return -1;
+  end = i;
+
+  // Going back from there finds where it starts
+  for (i = end - 1, j = qlen - 1; j >= 0; i--) {
+    if (LOWER(line[i]) == LOWER(q[j])) j--;
+  }
+  start = i + 1;
+
+  for (indent = 0; indent < len && (line[indent] == ' ' || line[indent] == '\t'); indent++);
+
+  score = 0;
+  last = -1;
+  for (i = start, j = 0; i < end && j < qlen; i++) {
+    if (LOWER(line[i]) != LOWER(q[j])) continue;
+    score += SCORE_MATCH + bonus(line, i, indent);
+    if (last >= 0 && i == last + 1) {
+      score += BONUS_RUN;
+    } else if (last >= 0) {
+      score -= PENALTY_GAP + PENALTY_SKIP * (i - last - 2);
+    }
+    last = i;
+    j++;
+  }
+
+  // Of otherwise equal lines the shorter one is the closer match
+  if (score < 0) score = 0;
+  return score * 64 + (len < 63 ? 63 - len : 0);
+}
+
+static int worse(const struct hit *a, const struct hit *b) {
+  return a->score < b->score || (a->score == b->score && a->pos > b->pos);
+}
+
+void keep_best(struct best *best, int score, int pos) {
+ /**
+  * Adds a line to the results if it is among the best so far
+  */
+  struct hit hit = {score, pos};
+  struct hit *h = best->hits;
+  int i, child;
+
+  if (best->count < FUZZY_BEST) {
+    // Sift the new hit up from the bottom
+    for (i = best->count++; i > 0 && worse(&hit, &h[(i - 1) / 2]); i = (i - 1) / 2) h[i] = h[(i - 1) / 2];
+    h[i] = hit;
+    return;
+  }
+
+  // Replace the worst hit on top and sift it down
+  if (!worse(&h[0], &hit)) return;
+  for (i = 0; (child = 2 * i + 1) < best->count; i = child) {
+    if (child + 1 < best->count && worse(&h[child + 1], &h[child])) child++;
+    if (!worse(&h[child], &hit)) break;
+    h[i] = h[child];
+  }
+  h[i] = hit;
+}
+
+void score_lines(struct best *best, const char *text, int len, int limit, int base, const char *query) {
+ /**
+  * Scores the lines of text that start before limit. The text starts at a
+  * line start, which is at position base.
+  */
+  const char *line = text;
+  const char *end = text + len;
+  const char *eol;
+  int qlen = strlen(query);
+  int n, score;
+
+  while (line < text + limit && line < end) {
+    eol = memchr(line, '\n', end - line);
+    if (!eol) eol = end;
+    n = eol - line;
+    if (n > 0 && line[n - 1] == '\r') n--;
+    score = fuzzy_score(line, n, query, qlen);
+    if (score >= 0) keep_best(best, score, base + (line - text));
+    line = eol + 1;
+  }
+}
+
+void merge_best(struct best *best, const struct best *more) {
+  int i;
+
+  for (i = 0; i < more->count; i++) keep_best(best, more->hits[i].score, more->hits[i].pos);
+}
+
+static int compare_hits(const void *a, const void *b) {
+  return worse(a, b) ? 1 : worse(b, a) ? -1 : 0;
+}
+
+void sort_best(struct best *best) {
+ /**
+  * Puts the results in order, best first. They are no longer a heap.
+  */
+  qsort(best->hits, best->count, sizeof(struct hit), compare_hits);
+}
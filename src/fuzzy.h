@@ -0,0 +1,19 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+typedef struct best best;
+typedef struct hit hit;
+struct hit {
+  int score;
+  int pos;                   // Start of the line
+};
+#define FUZZY_BEST     16              // Results kept by a fuzzy search
+struct best {
+  int count;
+  struct hit hits[FUZZY_BEST];
+};
+void sort_best(struct best *best);
+void merge_best(struct best *best,const struct best *more);
+void score_lines(struct best *best,const char *text,int len,int limit,int base,const char *query);
+void keep_best(struct best *best,int score,int pos);
+int fuzzy_score(const char *text,int len,const char *query,int qlen);
+#define INTERFACE 0
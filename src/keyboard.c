@@ -1,20 +1,104 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 
 #include "keyboard.h"
+#include "unicode.h"
 
 #if INTERFACE
 
 enum key_codes {KEY_BACKSPACE = 0x1008, KEY_ESC, KEY_INS, KEY_DEL, KEY_LEFT, 
   KEY_RIGHT, KEY_UP, KEY_DOWN, KEY_HOME, KEY_END, KEY_ENTER, KEY_TAB,
-  KEY_PGUP, KEY_PGDN, KEY_F3, KEY_UNKNOWN};
+  KEY_PGUP, KEY_PGDN, KEY_F3, KEY_PASTE, KEY_EVENT, KEY_SIGNAL, KEY_TIMER, KEY_UNKNOWN};
 
 #define ctrl(c) ((c) - 0x60)
 #define shift(c) ((c) + 0x1000)
+#define unicode(c) ((c) + 0x200000)
+#define unicode_char(k) ((k) - 0x200000)
 
 #endif
 
+#define INBUF          4096
+#define KEYBATCH       256
+#define KEYQUEUE       1024          // Must be a power of two
+#define PASTEBUF       65536
+#define ESCDELAY       25
+
+#define PASTE_END      "\033[201~"
+
+// Kitty keyboard protocol: query the current flags, followed by a primary
+// device attributes request that every terminal answers
+#define KITTY_QUERY    "\033[?u\033[c"
+#define KITTY_PUSH     "\033[>1u"
+#define KITTY_POP      "\033[<u"
+
+#define KITTY_SHIFT    1
+#define KITTY_ALT      2
+#define KITTY_CTRL     4
+#define KITTY_LOCKS    (64 | 128)
+
+#define KITTY_READY    (KEY_UNKNOWN + 1)   // Queued when the terminal answers the query
+
+#define MOD_SHIFT      1
+#define MOD_CTRL       2
+
+struct key_node {
+  short edges;               // First edge in key_edges
+  short count;               // Number of edges
+  int key;                   // Key for a sequence ending here, or 0
+  int mods;                  // Linux console modifiers that apply to the key
+};
+
+struct key_edge {
+  unsigned char ch;
+  short node;
+};
+
+#include "keys_table.h"
+
+struct key_event {
+  int key;
+  char *text;                // Pasted text for KEY_PASTE
+  int len;
+};
+
 int linux_console = 0;
+int escape_delay = ESCDELAY; // Milliseconds to wait for the rest of a sequence
+static atomic_int kitty_keys; // Terminal sends keys using the kitty protocol
+
+static unsigned char inbuf[INBUF];
+static int inpos, inlen;
+
+// Keys travel from the reader thread to the main thread through a single
+// producer, single consumer ring. Only the reader advances the tail and only
+// the main thread advances the head.
+static struct key_event keyqueue[KEYQUEUE];
+static atomic_uint keyhead;
+static atomic_uint keytail;
+static atomic_int keypeak;   // Deepest the queue has been since key_backlog()
+static int wakefd[2] = {-1, -1};
+static int stopfd[2] = {-1, -1};   // Written to when the reader has to stop
+static atomic_int stopping;
+static int epollfd = -1;     // Wake pipe and the descriptors given to watch_event()
+static pthread_t reader;
+
+static char *pasted;         // Text of the last KEY_PASTE taken from the queue
+static int pastedlen;
+static int input_ended;
+
+static char pastebuf[PASTEBUF];
+static int pastelen;
+static int pasting;
 
 void get_modifier_keys(int *shift, int *ctrl) {
   *shift = *ctrl = 0;
@@ -33,146 +117,398 @@ int add_modifiers(int key, int shift, int ctrl) {
   return key;
 }
 
-enum key_codes get_key() {
-  int ch, shift, ctrl;
-
-  ch = getchar();
-  if (ch < 0) return ch;
-
-  switch (ch) {
-    case 0x08: return KEY_BACKSPACE;
-    case 0x09:
-      get_modifier_keys(&shift, &ctrl);
-      return add_modifiers(KEY_TAB, shift, ctrl);
-    case 0x0D: return KEY_ENTER;
-    case 0x0A: return KEY_ENTER;
-    case 0x1B:
-      ch = getchar();
-      switch (ch) {
-        case 0x1B: return KEY_ESC;
-        case 0x4F:
-          ch = getchar();
-          switch (ch) {
-            case 0x46: return KEY_END;
-            case 0x48: return KEY_HOME;
-            case 0x52: return KEY_F3;
-            default: return KEY_UNKNOWN;
-          }
-          break;
-
-        case 0x5B:
-          get_modifier_keys(&shift, &ctrl);
-          ch = getchar();
-          if (ch == 0x31) {
-            ch = getchar();
-            switch (ch) {
-              case 0x3B:
-                ch = getchar();
-                if (ch == 0x32) shift = 1;
-                if (ch == 0x35) ctrl = 1;
-                if (ch == 0x36) shift = ctrl = 1;
-                ch = getchar();
-                break;
-              case 0x7E:
-                return add_modifiers(KEY_HOME, shift, ctrl);
-              default:
-                return KEY_UNKNOWN;
-            }
-          }
-
-          switch (ch) {
-            case 0x31: 
-              if (getchar() != 0x7E) return KEY_UNKNOWN;
-              return add_modifiers(KEY_HOME, shift, ctrl);
-            case 0x32: return getchar() == 0x7E ? KEY_INS : KEY_UNKNOWN;
-            case 0x33: return getchar() == 0x7E ? KEY_DEL : KEY_UNKNOWN;
-            case 0x34:
-              if (getchar() != 0x7E) return KEY_UNKNOWN;
-              return add_modifiers(KEY_END, shift, ctrl);
-            case 0x35:
-              if (getchar() != 0x7E) return KEY_UNKNOWN;
-              return add_modifiers(KEY_PGUP, shift, 0);
-            case 0x36:
-              if (getchar() != 0x7E) return KEY_UNKNOWN;
-              return add_modifiers(KEY_PGDN, shift, 0);
-            case 0x41: 
-              return add_modifiers(KEY_UP, shift, ctrl);
-            case 0x42: 
-              return add_modifiers(KEY_DOWN, shift, ctrl);
-            case 0x43: 
-              return add_modifiers(KEY_RIGHT, shift, ctrl);
-            case 0x44:
-              return add_modifiers(KEY_LEFT, shift, ctrl);
-            case 0x46:
-              return add_modifiers(KEY_END, shift, ctrl);
-            case 0x48:
-              return add_modifiers(KEY_HOME, shift, ctrl);
-            case 0x5A: 
-              return shift(KEY_TAB);
-            case 0x5B:
-              ch = getchar();
-              switch (ch) {
-                case 0x43: return KEY_F3;
-              }
-              return KEY_UNKNOWN;
-
-            default: return KEY_UNKNOWN;
-          }
-          break;
-
-        default: return KEY_UNKNOWN;
-      }
-      break;
-
-    case 0x00:
-    case 0xE0:
-      ch = getchar();
-      switch (ch) {
-        case 0x0F: return shift(KEY_TAB);
-        case 0x3D: return KEY_F3;
-        case 0x47: return KEY_HOME;
-        case 0x48: return KEY_UP;
-        case 0x49: return KEY_PGUP;
-        case 0x4B: return KEY_LEFT;
-        case 0x4D: return KEY_RIGHT;
-        case 0x4F: return KEY_END;
-        case 0x50: return KEY_DOWN;
-        case 0x51: return KEY_PGDN;
-        case 0x52: return KEY_INS;
-        case 0x53: return KEY_DEL;
-        case 0x73: return ctrl(KEY_LEFT);
-        case 0x74: return ctrl(KEY_RIGHT);
-        case 0x75: return ctrl(KEY_END);
-        case 0x77: return ctrl(KEY_HOME);
-        case 0x8D: return ctrl(KEY_UP);
-        case 0x91: return ctrl(KEY_DOWN);
-        case 0x94: return ctrl(KEY_TAB);
-        case 0xB8: return shift(KEY_UP);
-        case 0xB7: return shift(KEY_HOME);
-        case 0xBF: return shift(KEY_END);
-        case 0xB9: return shift(KEY_PGUP);
-        case 0xBB: return shift(KEY_LEFT);
-        case 0xBD: return shift(KEY_RIGHT);
-        case 0xC0: return shift(KEY_DOWN);
-        case 0xC1: return shift(KEY_PGDN);
-        case 0xDB: return shift(ctrl(KEY_LEFT));
-        case 0xDD: return shift(ctrl(KEY_RIGHT));
-        case 0xD8: return shift(ctrl(KEY_UP));
-        case 0xE0: return shift(ctrl(KEY_DOWN));
-        case 0xD7: return shift(ctrl(KEY_HOME));
-        case 0xDF: return shift(ctrl(KEY_END));
-
-        default: return KEY_UNKNOWN;
+static int wait_input(int timeout) {
+  struct pollfd pfd[2] = {{0, POLLIN, 0}, {stopfd[0], POLLIN, 0}};
+  return poll(pfd, 2, timeout) > 0 && pfd[0].revents;
+}
+
+static int read_input() {
+  int n;
+
+  if (inpos > 0) {
+    memmove(inbuf, inbuf + inpos, inlen - inpos);
+    inlen -= inpos;
+    inpos = 0;
+  }
+
+  // Standard input stays blocking, since it shares its file status flags
+  // with standard output on a terminal, so read only once poll says so
+  for (;;) {
+    if (atomic_load(&stopping)) return -1;
+    if (!wait_input(-1)) continue;
+    n = read(0, inbuf + inlen, INBUF - inlen);
+    if (n >= 0 || errno != EINTR) break;
+  }
+  if (n > 0) inlen += n;
+  return n;
+}
+
+static const struct key_node *next_node(const struct key_node *node, int ch) {
+  const struct key_edge *edge = key_edges + node->edges;
+  const struct key_edge *end = edge + node->count;
+
+  for (; edge < end && edge->ch <= ch; edge++) {
+    if (edge->ch == ch) return key_nodes + edge->node;
+  }
+  return NULL;
+}
+
+static int csi_number(const unsigned char *p, int len, int *i) {
+  int n = 0;
+  while (*i < len && p[*i] >= '0' && p[*i] <= '9') n = n * 10 + p[(*i)++] - '0';
+  return n;
+}
+
+static int kitty_key(const unsigned char *p, int len) {
+ /**
+  * Translates the parameters of a CSI u sequence from the kitty keyboard
+  * protocol, or the terminal's answer to the protocol query
+  */
+  int i = 0;
+  int code, mods = 0;
+
+  // The main thread turns the protocol on, as it owns the output
+  if (len > 0 && p[0] == '?') return KITTY_READY;
+
+  code = csi_number(p, len, &i);
+  while (i < len && p[i] != ';') i++;
+  if (i < len) {
+    i++;
+    mods = csi_number(p, len, &i) - 1;
+  }
+  if (mods < 0) mods = 0;
+
+  // The legacy encoding only puts an escape in front of a key held with Alt
+  mods &= ~(KITTY_LOCKS | KITTY_ALT);
+
+  switch (code) {
+    case 9: return add_modifiers(KEY_TAB, mods & KITTY_SHIFT, mods & KITTY_CTRL);
+    case 13: return add_modifiers(KEY_ENTER, mods & KITTY_SHIFT, mods & KITTY_CTRL);
+    case 27: return add_modifiers(KEY_ESC, mods & KITTY_SHIFT, mods & KITTY_CTRL);
+    case 127: return add_modifiers(KEY_BACKSPACE, mods & KITTY_SHIFT, mods & KITTY_CTRL);
+  }
+
+  // Functional keys without a legacy encoding use the private use area
+  if (code < ' ' || (code >= 0xE000 && code <= 0xF8FF)) return KEY_UNKNOWN;
+
+  if (mods & ~(KITTY_SHIFT | KITTY_CTRL)) return KEY_UNKNOWN;
+  if (code >= 'a' && code <= 'z') {
+    // As with the legacy encoding, Ctrl+Shift+letter is Ctrl+letter
+    if (mods & KITTY_CTRL) return ctrl(code);
+    if (mods & KITTY_SHIFT) return code - 'a' + 'A';
+  }
+  if (mods & KITTY_CTRL) return KEY_UNKNOWN;
+  return code < 0x80 ? code : unicode(code);
+}
+
+static int decode_key(const unsigned char *p, int len, int final, int *key, int *shift, int *ctrl) {
+ /**
+  * Decodes the key at the start of p. When final is set no more input is
+  * coming, so an incomplete key is decoded as far as it goes.
+  * @return The number of bytes used, or zero if the key is incomplete
+  */
+  const struct key_node *node = key_nodes;
+  const struct key_node *next;
+  int n = 0;
+  int cp;
+
+  while (n < len && (next = next_node(node, p[n]))) {
+    node = next;
+    n++;
+  }
+
+  if (node == key_nodes) {
+    if (p[0] < 0x80) {
+      *key = p[0];
+      return 1;
+    }
+    if (len < utf8_length(p[0]) && !final) return 0;
+    n = utf8_decode((const char *) p, len, &cp);
+    *key = n > 1 ? unicode(cp) : KEY_UNKNOWN;
+    return n;
+  }
+
+  if (node->key && (n == len || final || node->count == 0 || !next_node(node, p[n]))) {
+    *key = node->key;
+    if (node->mods) {
+      if (*shift < 0) get_modifier_keys(shift, ctrl);
+      *key = add_modifiers(*key, *shift && (node->mods & MOD_SHIFT), *ctrl && (node->mods & MOD_CTRL));
+    }
+    return n;
+  }
+
+  if (n == len && !final) return 0;
+
+  // An escape that does not start a sequence is the Esc key
+  if (n == 1 && p[0] == 0x1B) {
+    *key = KEY_ESC;
+    return 1;
+  }
+
+  // Skip the rest of an unrecognized control sequence
+  if (n >= 2 && p[0] == 0x1B && p[1] == '[') {
+    while (n < len && p[n] >= 0x20 && p[n] < 0x40) n++;
+    if (n == len && !final) return 0;
+    if (n < len && p[n++] == 'u') {
+      *key = kitty_key(p + 2, n - 3);
+      return n;
+    }
+  }
+
+  *key = KEY_UNKNOWN;
+  return n;
+}
+
+static int paste_input(const unsigned char *p, int len) {
+ /**
+  * Collects pasted text up to the end of paste marker
+  * @return The number of bytes used
+  */
+  int markerlen = strlen(PASTE_END);
+  const unsigned char *end = memmem(p, len, PASTE_END, markerlen);
+  int n, used;
+
+  if (end) {
+    n = used = end - p;
+    used += markerlen;
+    pasting = 0;
+  } else {
+    // Hold back anything that could be the start of the marker
+    for (n = len > markerlen ? len - markerlen : 0; n < len; n++) {
+      if (!memcmp(p + n, PASTE_END, len - n)) break;
+    }
+    used = n;
+  }
+
+  if (n > PASTEBUF - pastelen) n = PASTEBUF - pastelen;
+  memcpy(pastebuf + pastelen, p, n);
+  pastelen += n;
+  return used;
+}
+
+
+int get_keys(int *keys, int max) {
+ /**
+  * Reads all available input and decodes it
+  * @return The number of keys stored in keys, or -1 at end of input
+  */
+  int count = 0;
+  int shift = -1, ctrl = -1;
+  int final = 0;
+  int n;
+
+  for (;;) {
+    while (count < max && inpos < inlen) {
+      if (pasting) {
+        inpos += paste_input(inbuf + inpos, inlen - inpos);
+        if (pasting) break;
+        // Only one paste per batch, so the paste buffer stays valid
+        keys[count++] = KEY_PASTE;
+        return count;
       }
-      break;
 
-    case 0x7F: return KEY_BACKSPACE;
+      n = decode_key(inbuf + inpos, inlen - inpos, final, &keys[count], &shift, &ctrl);
+      if (!n) break;
+      inpos += n;
 
-    default:
-      if ((ch & 0b10000000) == 0b00000000) { return ch; }
-      if ((ch & 0b11100000) == 0b11000000) { 
-        return ((int)ch << 8) + getchar();
+      if (keys[count] == KEY_PASTE) {
+        pasting = 1;
+        pastelen = 0;
+        if (count > 0) return count;
+        continue;
       }
-      return 0;
+      count++;
+    }
+
+    if (count > 0) return count;
+
+    // A key left incomplete for longer than the escape delay is taken as is.
+    // Keys sent using the kitty protocol are never ambiguous.
+    if (inpos < inlen && !pasting && !final && !kitty_keys && !wait_input(escape_delay)) {
+      final = 1;
+      continue;
+    }
+    final = 0;
+    if (read_input() <= 0) return -1;
+  }
+}
+
+static void push_key(int key) {
+  unsigned tail = atomic_load_explicit(&keytail, memory_order_relaxed);
+  struct key_event *ev;
+  int depth;
+
+  // Wait for the main thread to make room rather than lose input
+  while (tail - atomic_load_explicit(&keyhead, memory_order_acquire) == KEYQUEUE) {
+    if (atomic_load(&stopping)) return;
+    usleep(1000);
+  }
+
+  ev = &keyqueue[tail % KEYQUEUE];
+  ev->key = key;
+  ev->text = NULL;
+  ev->len = 0;
+  if (key == KEY_PASTE) {
+    ev->text = malloc(pastelen + 1);
+    if (!ev->text) return;
+    memcpy(ev->text, pastebuf, pastelen);
+    ev->len = pastelen;
+  }
+  atomic_store_explicit(&keytail, tail + 1, memory_order_release);
+
+  depth = tail + 1 - atomic_load_explicit(&keyhead, memory_order_relaxed);
+  if (depth > atomic_load_explicit(&keypeak, memory_order_relaxed)) {
+    atomic_store_explicit(&keypeak, depth, memory_order_relaxed);
+  }
+}
+
+static void *read_keys(void *arg) {
+  int keys[KEYBATCH];
+  int n, i;
+
+  (void) arg;
+  do {
+    n = get_keys(keys, KEYBATCH);
+    if (n < 0) push_key(-1);
+    for (i = 0; i < n; i++) push_key(keys[i]);
+    if (write(wakefd[1], "", 1) < 0) {
+      // The pipe is full, so the main thread has a wakeup pending anyway
+    }
+  } while (n >= 0);
+
+  return NULL;
+}
+
+static int queued_keys() {
+  return atomic_load_explicit(&keytail, memory_order_acquire) - atomic_load_explicit(&keyhead, memory_order_relaxed);
+}
+
+static int wait_key() {
+ /**
+  * Sleeps until the reader thread queues a key or a watched descriptor
+  * becomes readable
+  * @return The key given to watch_event() for the descriptor, or zero
+  */
+  struct epoll_event ev;
+  char buf[64];
+
+  while (!queued_keys()) {
+    if (epoll_wait(epollfd, &ev, 1, -1) <= 0) continue;
+    if (ev.data.u32) {
+      if (!queued_keys()) return ev.data.u32;
+    } else {
+      while (read(wakefd[0], buf, sizeof(buf)) > 0);
+    }
+  }
+  return 0;
+}
+
+static int pop_key() {
+  unsigned head = atomic_load_explicit(&keyhead, memory_order_relaxed);
+  struct key_event *ev = &keyqueue[head % KEYQUEUE];
+  int key = ev->key;
+
+  if (ev->text) {
+    free(pasted);
+    pasted = ev->text;
+    pastedlen = ev->len;
   }
+  atomic_store_explicit(&keyhead, head + 1, memory_order_release);
+  return key;
+}
+
+
+char *get_paste(int *len) {
+  *len = pastedlen;
+  return pasted;
+}
+
+int key_backlog() {
+ /**
+  * Reports how far the main thread has fallen behind the keyboard
+  * @return The largest number of keys queued since the last call
+  */
+  return atomic_exchange_explicit(&keypeak, queued_keys(), memory_order_relaxed);
+}
+
+int key_pending() {
+  return queued_keys() > 0;
+}
+
+int peek_key() {
+ /**
+  * Looks at the next key already read without consuming it
+  * @return The key, or zero if no decoded key is waiting
+  */
+  if (!queued_keys()) return 0;
+  return keyqueue[atomic_load_explicit(&keyhead, memory_order_relaxed) % KEYQUEUE].key;
+}
+
+int get_repeat(int key) {
+ /**
+  * Consumes any copies of key queued right after it
+  * @return The number of times key was pressed
+  */
+  int n = 1;
+  while (peek_key() == key) {
+    pop_key();
+    n++;
+  }
+  return n;
+}
+
+int get_key() {
+  int key;
+
+  if (input_ended) return -1;
+  key = wait_key();
+  if (key) return key;
+  key = pop_key();
+  if (key < 0) input_ended = 1;
+  if (key == KITTY_READY) {
+    if (!kitty_keys) {
+      fputs(KITTY_PUSH, stdout);
+      fflush(stdout);
+      kitty_keys = 1;
+    }
+    key = KEY_UNKNOWN;
+  }
+  return key;
+}
+
+int watch_event(int fd, int key) {
+ /**
+  * Makes get_key() return key while fd is readable and no key is waiting
+  */
+  struct epoll_event ev;
+
+  if (fd < 0) return -1;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u32 = key;
+  return epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void open_keyboard() {
+  char *delay = getenv("ESCDELAY");
+
+  if (delay && *delay) escape_delay = atoi(delay);
+
+  fputs(KITTY_QUERY, stdout);
+  fflush(stdout);
+
+  epollfd = epoll_create1(EPOLL_CLOEXEC);
+  if (pipe2(wakefd, O_NONBLOCK | O_CLOEXEC) < 0 || pipe2(stopfd, O_CLOEXEC) < 0 || watch_event(wakefd[0], 0) < 0 || pthread_create(&reader, NULL, read_keys, NULL)) {
+    perror("keyboard");
+    exit(1);
+  }
+}
+
+
+void close_keyboard() {
+  atomic_store(&stopping, 1);
+  if (write(stopfd[1], "", 1) < 0 || pthread_join(reader, NULL)) perror("keyboard");
+
+  if (kitty_keys) fputs(KITTY_POP, stdout);
+  kitty_keys = 0;
 }
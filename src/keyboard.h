@@ -0,0 +1,25 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+void close_keyboard();
+void open_keyboard();
+int watch_event(int fd,int key);
+int get_key();
+int get_repeat(int key);
+int peek_key();
+int key_pending();
+int key_backlog();
+char *get_paste(int *len);
+int get_keys(int *keys,int max);
+#define shift(c) ((c) + 0x1000)
+#define ctrl(c) ((c) - 0x60)
+int add_modifiers(int key,int shift,int ctrl);
+void get_modifier_keys(int *shift,int *ctrl);
+extern int escape_delay;
+extern int linux_console;
+#define unicode_char(k) ((k) - 0x200000)
+#define unicode(c) ((c) + 0x200000)
+enum key_codes {KEY_BACKSPACE = 0x1008, KEY_ESC, KEY_INS, KEY_DEL, KEY_LEFT, 
+  KEY_RIGHT, KEY_UP, KEY_DOWN, KEY_HOME, KEY_END, KEY_ENTER, KEY_TAB,
+  KEY_PGUP, KEY_PGDN, KEY_F3, KEY_PASTE, KEY_EVENT, KEY_SIGNAL, KEY_TIMER, KEY_UNKNOWN};
+typedef enum key_codes key_codes;
+#define INTERFACE 0
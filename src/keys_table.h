@@ -0,0 +1,208 @@
+/* This file was automatically generated by mkkeys.  Do not edit! */
+
+static const struct key_node key_nodes[101] = {
+  {0, 7, 0, 0},
+  {7, 0, KEY_BACKSPACE, 0},
+  {7, 0, KEY_TAB, 3},
+  {7, 0, KEY_ENTER, 0},
+  {7, 0, KEY_ENTER, 0},
+  {7, 0, KEY_BACKSPACE, 0},
+  {7, 3, 0, 0},
+  {10, 0, KEY_ESC, 0},
+  {10, 3, 0, 0},
+  {13, 0, KEY_END, 0},
+  {13, 0, KEY_HOME, 0},
+  {13, 0, KEY_F3, 0},
+  {13, 14, 0, 0},
+  {27, 3, 0, 0},
+  {30, 0, KEY_HOME, 3},
+  {30, 3, 0, 0},
+  {33, 0, KEY_INS, 0},
+  {33, 1, 0, 0},
+  {34, 0, KEY_DEL, 0},
+  {34, 1, 0, 0},
+  {35, 0, KEY_END, 3},
+  {35, 1, 0, 0},
+  {36, 0, KEY_PGUP, 1},
+  {36, 1, 0, 0},
+  {37, 0, KEY_PGDN, 1},
+  {37, 2, 0, 0},
+  {39, 0, KEY_F3, 0},
+  {39, 1, 0, 0},
+  {40, 1, 0, 0},
+  {41, 0, shift(KEY_F3), 0},
+  {41, 1, 0, 0},
+  {42, 0, shift(KEY_F3), 0},
+  {42, 3, 0, 0},
+  {45, 7, 0, 0},
+  {52, 0, shift(KEY_F3), 0},
+  {52, 0, KEY_UP, 3},
+  {52, 0, KEY_DOWN, 3},
+  {52, 0, KEY_RIGHT, 3},
+  {52, 0, KEY_LEFT, 3},
+  {52, 0, KEY_END, 3},
+  {52, 0, KEY_HOME, 3},
+  {52, 0, shift(KEY_TAB), 0},
+  {52, 1, 0, 0},
+  {53, 0, KEY_F3, 0},
+  {53, 1, 0, 0},
+  {54, 1, 0, 0},
+  {55, 0, KEY_PASTE, 0},
+  {55, 33, 0, 0},
+  {88, 0, shift(KEY_TAB), 0},
+  {88, 0, KEY_F3, 0},
+  {88, 0, KEY_HOME, 0},
+  {88, 0, KEY_UP, 0},
+  {88, 0, KEY_PGUP, 0},
+  {88, 0, KEY_LEFT, 0},
+  {88, 0, KEY_RIGHT, 0},
+  {88, 0, KEY_END, 0},
+  {88, 0, KEY_DOWN, 0},
+  {88, 0, KEY_PGDN, 0},
+  {88, 0, KEY_INS, 0},
+  {88, 0, KEY_DEL, 0},
+  {88, 0, ctrl(KEY_LEFT), 0},
+  {88, 0, ctrl(KEY_RIGHT), 0},
+  {88, 0, ctrl(KEY_END), 0},
+  {88, 0, ctrl(KEY_HOME), 0},
+  {88, 0, ctrl(KEY_UP), 0},
+  {88, 0, ctrl(KEY_DOWN), 0},
+  {88, 0, ctrl(KEY_TAB), 0},
+  {88, 0, shift(KEY_UP), 0},
+  {88, 0, shift(KEY_HOME), 0},
+  {88, 0, shift(KEY_END), 0},
+  {88, 0, shift(KEY_PGUP), 0},
+  {88, 0, shift(KEY_LEFT), 0},
+  {88, 0, shift(KEY_RIGHT), 0},
+  {88, 0, shift(KEY_DOWN), 0},
+  {88, 0, shift(KEY_PGDN), 0},
+  {88, 0, shift(ctrl(KEY_LEFT)), 0},
+  {88, 0, shift(ctrl(KEY_RIGHT)), 0},
+  {88, 0, shift(ctrl(KEY_UP)), 0},
+  {88, 0, shift(ctrl(KEY_DOWN)), 0},
+  {88, 0, shift(ctrl(KEY_HOME)), 0},
+  {88, 0, shift(ctrl(KEY_END)), 0},
+  {88, 0, shift(KEY_UP), 0},
+  {88, 6, 0, 0},
+  {94, 0, ctrl(KEY_UP), 0},
+  {94, 6, 0, 0},
+  {100, 0, shift(ctrl(KEY_UP)), 0},
+  {100, 0, shift(KEY_DOWN), 0},
+  {100, 0, ctrl(KEY_DOWN), 0},
+  {100, 0, shift(ctrl(KEY_DOWN)), 0},
+  {100, 0, shift(KEY_RIGHT), 0},
+  {100, 0, ctrl(KEY_RIGHT), 0},
+  {100, 0, shift(ctrl(KEY_RIGHT)), 0},
+  {100, 0, shift(KEY_LEFT), 0},
+  {100, 0, ctrl(KEY_LEFT), 0},
+  {100, 0, shift(ctrl(KEY_LEFT)), 0},
+  {100, 0, shift(KEY_END), 0},
+  {100, 0, ctrl(KEY_END), 0},
+  {100, 0, shift(ctrl(KEY_END)), 0},
+  {100, 0, shift(KEY_HOME), 0},
+  {100, 0, ctrl(KEY_HOME), 0},
+  {100, 0, shift(ctrl(KEY_HOME)), 0},
+};
+
+static const struct key_edge key_edges[100] = {
+  {0x00, 47},
+  {0x08, 1},
+  {0x09, 2},
+  {0x0A, 3},
+  {0x0D, 4},
+  {0x1B, 6},
+  {0x7F, 5},
+  {0x1B, 7},
+  {0x4F, 8},
+  {0x5B, 12},
+  {0x46, 9},
+  {0x48, 10},
+  {0x52, 11},
+  {0x31, 13},
+  {0x32, 15},
+  {0x33, 17},
+  {0x34, 19},
+  {0x35, 21},
+  {0x36, 23},
+  {0x41, 35},
+  {0x42, 36},
+  {0x43, 37},
+  {0x44, 38},
+  {0x46, 39},
+  {0x48, 40},
+  {0x5A, 41},
+  {0x5B, 42},
+  {0x33, 25},
+  {0x3B, 32},
+  {0x7E, 14},
+  {0x30, 44},
+  {0x35, 30},
+  {0x7E, 16},
+  {0x7E, 18},
+  {0x7E, 20},
+  {0x7E, 22},
+  {0x7E, 24},
+  {0x3B, 27},
+  {0x7E, 26},
+  {0x32, 28},
+  {0x7E, 29},
+  {0x7E, 31},
+  {0x32, 33},
+  {0x35, 82},
+  {0x36, 84},
+  {0x41, 81},
+  {0x42, 86},
+  {0x43, 89},
+  {0x44, 92},
+  {0x46, 95},
+  {0x48, 98},
+  {0x52, 34},
+  {0x43, 43},
+  {0x30, 45},
+  {0x7E, 46},
+  {0x0F, 48},
+  {0x3D, 49},
+  {0x47, 50},
+  {0x48, 51},
+  {0x49, 52},
+  {0x4B, 53},
+  {0x4D, 54},
+  {0x4F, 55},
+  {0x50, 56},
+  {0x51, 57},
+  {0x52, 58},
+  {0x53, 59},
+  {0x73, 60},
+  {0x74, 61},
+  {0x75, 62},
+  {0x77, 63},
+  {0x8D, 64},
+  {0x91, 65},
+  {0x94, 66},
+  {0xB7, 68},
+  {0xB8, 67},
+  {0xB9, 70},
+  {0xBB, 71},
+  {0xBD, 72},
+  {0xBF, 69},
+  {0xC0, 73},
+  {0xC1, 74},
+  {0xD7, 79},
+  {0xD8, 77},
+  {0xDB, 75},
+  {0xDD, 76},
+  {0xDF, 80},
+  {0xE0, 78},
+  {0x41, 83},
+  {0x42, 87},
+  {0x43, 90},
+  {0x44, 93},
+  {0x46, 96},
+  {0x48, 99},
+  {0x41, 85},
+  {0x42, 88},
+  {0x43, 91},
+  {0x44, 94},
+  {0x46, 97},
+  {0x48, 100},
+};
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "keywords.h"
+
+#if INTERFACE
+
+// An Aho-Corasick automaton with every failure transition worked out in
+// advance, so matching takes one table lookup per byte however many
+// keywords there are
+struct keywords {
+  int states;
+  unsigned short (*next)[256];     // Transitions of each state
+  unsigned char *length;           // Longest keyword ending in each state, or 0
+};
+
+struct span {
+  int start, end;
+};
+
+#endif
+
+#define MAX_STATES     65535
+#define MAX_KEYWORD    255
+
+struct keywords *compile_keywords(const char *list) {
+ /**
+  * Builds an automaton for a comma-separated list of keywords
+  * @return The automaton, or NULL if the list is empty or out of memory
+  */
+  struct keywords *kw;
+  unsigned short *fail, *queue;
+  const char *p, *end;
+  int size, s, r, c, n, head, tail;
+
+  if (!list) return NULL;
+  size = strlen(list) + 1;
+  if (size > MAX_STATES) size = MAX_STATES;
+
+  kw = calloc(1, sizeof(struct keywords));
+  if (!kw) return NULL;
+  kw->next = calloc(size, sizeof(*kw->next));
+  kw->length = calloc(size, 1);
+  fail = calloc(size, sizeof(unsigned short));
+  queue = calloc(size, sizeof(unsigned short));
+  if (!kw->next || !kw->length || !fail || !queue) goto err;
+
+  // The keywords make up a trie first, with state 0 as its root
+  kw->states = 1;
+  for (p = list; *p; p = *end ? end + 1 : end) {
+    end = strchr(p, ',');
+    if (!end) end = p + strlen(p);
+    n = end - p;
+    if (n == 0 || n > MAX_KEYWORD || kw->states + n > size) continue;
+    for (s = 0; p < end; p++) {
+      c = (unsigned char) *p;
+      if (!kw->next[s][c]) kw->next[s][c] = kw->states++;
+      s = kw->next[s][c];
+    }
+    kw->length[s] = n;
+  }
+  if (kw->states == 1) goto err;
+
+  // Breadth first, each missing transition becomes the one its failure
+  // state takes, which is already complete
+  head = tail = 0;
+  for (c = 0; c < 256; c++) {
+    if (kw->next[0][c]) queue[tail++] = kw->next[0][c];
+  }
+  while (head < tail) {
+    r = queue[head++];
+    if (kw->length[fail[r]] > kw->length[r]) kw->length[r] = kw->length[fail[r]];
+    for (c = 0; c < 256; c++) {
+      s = kw->next[r][c];
+      if (s) {
+        fail[s] = kw->next[fail[r]][c];
+        queue[tail++] = s;
+      } else {
+        kw->next[r][c] = kw->next[fail[r]][c];
+      }
+    }
+  }
+
+  free(fail);
+  free(queue);
+  return kw;
+
+err:
+  free(kw->next);
+  free(kw->length);
+  free(kw);
+  free(fail);
+  free(queue);
+  return NULL;
+}
+
+int find_keywords(const struct keywords *kw, const char *text, int len, struct span *spans, int max) {
+ /**
+  * Finds where keywords occur in text, joining ones that overlap or touch
+  * @return The number of spans, at most max
+  */
+  const unsigned char *p = (const unsigned char *) text;
+  int s = 0;
+  int n = 0;
+  int i, start;
+
+  for (i = 0; i < len; i++) {
+    s = kw->next[s][p[i]];
+    if (!kw->length[s]) continue;
+
+    start = i + 1 - kw->length[s];
+    while (n > 0 && spans[n - 1].end >= start) {
+      if (spans[n - 1].start < start) start = spans[n - 1].start;
+      n--;
+    }
+    if (n == max) break;
+    spans[n].start = start;
+    spans[n].end = i + 1;
+    n++;
+  }
+  return n;
+}
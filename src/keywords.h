@@ -0,0 +1,15 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+typedef struct keywords keywords;
+typedef struct span span;
+int find_keywords(const struct keywords *kw,const char *text,int len,struct span *spans,int max);
+struct keywords *compile_keywords(const char *list);
+struct span {
+  int start, end;
+};
+struct keywords {
+  int states;
+  unsigned short (*next)[256];     // Transitions of each state
+  unsigned char *length;           // Longest keyword ending in each state, or 0
+};
+#define INTERFACE 0
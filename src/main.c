@@ -1,16 +1,32 @@
+#define _GNU_SOURCE
+
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
 #include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <termios.h>
 
+#include "fuzzy.h"
 #include "keyboard.h"
+#include "keywords.h"
+#include "pool.h"
+#include "regex.h"
+#include "search.h"
+#include "snapshot.h"
+#include "symbols.h"
+#include "term.h"
+#include "trigram.h"
+#include "unicode.h"
 
 #define O_BINARY 0
 
@@ -19,20 +35,136 @@
 #define MAX_LINES      16384 
 
 #define MAXSIZE        32768
-#define LINEBUF        512
+#define LINEBUF        2048
+
+#define CHECKPOINT     1024
+#define MAX_CHECKPOINTS (MAXSIZE / CHECKPOINT + 2)
+
+#define WRAP_LINES     128
+#define MAX_WRAP_ROWS  256
 
 #define TABSIZE        2
 #define PAGESIZE       20
 #define INDENT         "  "
 
+#define AUTOSAVE       30              // Seconds from a change to the autosave
+
+#define SLICE_MS       50              // Time between progress checks
+#define SLICE_LINES    1024
+#define SLICE_BYTES    (MAXSIZE / 8)
+#define MATCH_WINDOW   4096            // Bytes searched at a time for highlighted matches
+#define COUNT_CHUNK    4096            // Bytes counted by each background job
+#define SCORE_CHUNK    4096            // Bytes of lines scored by each background job
+#define COUNT_CHUNKS   (MAXSIZE / COUNT_CHUNK + 1)
+#define INDEX_MIN      8192            // Texts at least this long are searched through a trigram index
+#define AUTOSAVE_SUFFIX ".autosave"
+
 #define CLRSCR         "\033[0J"
 #define CLREOL         "\033[K"
 #define GOTO_LINE_COL  "\033[%d;%dH"
 #define RESET_COLOR    "\033[0m"
+#define PASTE_ON       "\033[?2004h"
+#define PASTE_OFF      "\033[?2004l"
+
+struct checkpoint {
+  int offset;                // Byte offset from the start of the line
+  int col;                   // Screen column at that offset
+};
+
+struct checkpoints {
+  int linepos;               // Line the checkpoints belong to, or -1
+  int count;                 // Number of valid checkpoints
+  struct checkpoint cp[MAX_CHECKPOINTS];
+};
+
+struct wrap {
+  int linepos;               // Line the rows belong to, or -1
+  int length;                // Line length in bytes
+  int longline;              // Line is scrolled horizontally instead of wrapped
+  int rows;                  // Number of screen rows
+  unsigned short offsets[MAX_WRAP_ROWS];  // Byte offset of each row from the start of the line
+};
 
-#define TEXT_COLOR     "\033[0m"
-#define SELECT_COLOR   "\033[7m\033[1m"
-#define STATUS_COLOR   "\033[1m\033[7m"
+struct wraps {
+  int cols;                  // Screen size the rows were computed for
+  int lines;
+  int next;                  // Next entry to replace
+  struct wrap line[WRAP_LINES];
+};
+
+struct keyword_line {
+  int linepos;               // Line the keywords were found on, or -1
+  int length;                // Line length in bytes
+  int count;                 // Number of spans
+  int size;                  // Spans there is room for
+  struct span *spans;        // Keyword matches relative to the start of the line
+};
+
+struct keyword_lines {
+  int next;                  // Next entry to replace
+  struct keyword_line line[WRAP_LINES];
+};
+
+struct progress {
+  char *what;                // Operation shown in the status line
+  long long next;            // Time of the next check, in milliseconds
+};
+
+struct matches {
+  int length;                // Length of the highlighted text, or zero
+  int textlen;               // Length of the buffer when the frame started
+  int next;                  // Start of the next match, or -1 if not yet found
+  int checked;               // No other match starts before this position
+  int any_case;              // Matches ignore case
+  char text[LINEBUF];        // Text highlighted wherever it appears on screen
+};
+
+struct chunk {
+  int count_id;              // Count the chunk belongs to
+  int start, end;            // Matches starting in this range are counted
+  int any_case;
+  int count;
+  char text[LINEBUF];
+  int offsets[COUNT_CHUNK];
+};
+
+struct reindex {
+  int first;                 // First chunk indexed
+  int chunks;                // Chunks in the text
+  struct trigrams trigrams;
+};
+
+struct scoring {
+  int query_id;              // Query the chunk is scored for
+  int start, end;            // Lines starting in this range are scored
+  char query[LINEBUF];
+  struct best best;
+};
+
+struct finder {
+  int query_id;              // Incremented for every new query
+  int pending;               // Chunks still being scored
+  int selected;              // Result picked with Up and Down
+  int shown;                 // Screen rows the results take up
+  char query[LINEBUF];       // Query the results are for
+  struct best best;          // Best lines so far, best first once all are scored
+};
+
+struct reparse {
+  int from;                  // Where parsing starts
+  struct symbols symbols;
+};
+
+struct matchlist {
+  int count_id;              // Incremented for every new count
+  unsigned generation;       // Buffer generation the matches were counted for
+  int pending;               // Chunks still being counted
+  int total;                 // Number of matches once all chunks are counted
+  int any_case;
+  int counts[COUNT_CHUNKS];  // Matches found in each chunk
+  char text[LINEBUF];        // Text the matches are for
+  int offsets[MAXSIZE];      // Start of every match in increasing order
+};
 
 struct editor {
   int clipsize;
@@ -50,10 +182,39 @@ struct editor {
   int cursor_screen_col;     // Cursor screen line
   int col;                   // Current document column
   int lastcol;               // Remembered column from last horizontal navigation
+  int goal;                  // Remembered screen column within a row from last vertical navigation
+  int goalpos;               // Text position the goal applies to
   int anchor;                // Anchor position for selection
+  int any_case;              // Searches ignore case
+  int search_origin;         // Position the incremental search started from
+  int search_backward;       // The incremental search goes backwards
   
   int permissions;           // File permissions
 
+  unsigned generation;       // Incremented by every change to the text
+  unsigned reindexed;        // Generation the trigram index was requested for
+  int indexed;               // Leading chunks the trigram index is right for
+  int has_symbols;           // The text is C or C++, so its symbols are indexed
+  unsigned reparsed;         // Generation the symbols were requested for
+  int parse_from;            // Where the symbols have to be parsed from
+  unsigned autosaved;        // Generation last written to the file or autosave file
+  int autosave_armed;        // Autosave timer is running
+  int recover;               // An earlier session left an autosave file behind
+  int quit;                  // Asked to terminate
+
+  int signalfd;              // Delivers SIGWINCH and SIGTERM
+  int timerfd;               // Autosave timer
+
+  struct checkpoints checkpoints;  // Column checkpoints for the current line
+  struct wraps wraps;              // Wrapped rows for recently displayed lines
+  struct keywords *keywords;       // Keywords always highlighted, or NULL
+  struct keyword_lines keyword_lines;  // Keywords on recently displayed lines
+  struct matches matches;          // Matches highlighted in the current frame
+  struct matchlist matchlist;      // Every match of the highlighted text
+  struct trigrams trigrams;        // Chunks each trigram occurs in
+  struct symbols symbols;          // Declarations found by the makeheaders parser
+  struct finder finder;            // Lines matching the Goto Anything text
+
   char filename[FILENAME_MAX];
 
   char linebuf[LINEBUF];     // Scratch buffer
@@ -63,14 +224,30 @@ struct editor {
   char clipboard[MAXSIZE];
 };
 
+int slice_ms = SLICE_MS;     // Milliseconds between progress checks, EM9_SLICE_MS
+
 //
 // Editor buffer functions
 //
 
+int c_source(char *filename) {
+  // Tells from the extension whether the makeheaders parser can read a file
+  static char *extensions[] = {".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", ".hxx", ".C", ".H", NULL};
+  char *ext = strrchr(filename, '.');
+  int i;
+
+  if (!ext || strchr(ext, '/')) return 0;
+  for (i = 0; extensions[i]; i++) {
+    if (!strcmp(ext, extensions[i])) return 1;
+  }
+  return 0;
+}
+
 int load_file(struct editor *ed, char *filename) {
+  char autosave_name[FILENAME_MAX + sizeof(AUTOSAVE_SUFFIX)];
   struct stat statbuf;
   int length;
-  int f;
+  int f, i;
 
   if (!realpath(filename, ed->filename)) return -1;
   f = open(ed->filename, O_RDONLY | O_BINARY);
@@ -83,7 +260,38 @@ int load_file(struct editor *ed, char *filename) {
   if (length > MAXSIZE) goto err;
   if (read(f, ed->content, length) != length) goto err;
 
+  snprintf(autosave_name, sizeof(autosave_name), "%s" AUTOSAVE_SUFFIX, ed->filename);
+  ed->recover = access(autosave_name, F_OK) == 0;
+
   ed->anchor = -1;
+  ed->margin = 0;
+  ed->checkpoints.linepos = -1;
+  ed->wraps.cols = -1;
+  for (i = 0; i < WRAP_LINES; i++) {
+    ed->keyword_lines.line[i].linepos = -1;
+    ed->keyword_lines.line[i].size = 0;
+    ed->keyword_lines.line[i].spans = NULL;
+  }
+  ed->matches.length = 0;
+  ed->any_case = 0;
+  ed->matchlist.count_id = 0;
+  ed->matchlist.text[0] = 0;
+  ed->goalpos = -1;
+  ed->generation = 0;
+  ed->reindexed = -1;
+  ed->indexed = 0;
+  ed->has_symbols = c_source(ed->filename);
+  ed->reparsed = -1;
+  ed->parse_from = 0;
+  ed->symbols.count = 0;
+  ed->finder.query_id = 0;
+  ed->finder.query[0] = 0;
+  ed->finder.best.count = 0;
+  ed->finder.shown = 0;
+  ed->autosaved = 0;
+  ed->autosave_armed = 0;
+  ed->quit = 0;
+  ed->signalfd = ed->timerfd = -1;
 
   close(f);
   return 0;
@@ -109,15 +317,72 @@ err:
   return -1;
 }
 
+void invalidate_layout(struct editor *ed, int pos, int removed, int added) {
+ /**
+  * Updates cached line layout for an edit replacing removed bytes at pos with
+  * added bytes. Lines after the edit are shifted, the edited line is dropped.
+  */
+  struct checkpoints *cps = &ed->checkpoints;
+  struct keyword_line *kl;
+  struct wrap *wrap;
+  int i;
+
+  if (pos + removed < cps->linepos) {
+    cps->linepos += added - removed;
+  } else if (pos < cps->linepos) {
+    cps->linepos = -1;
+  } else {
+    while (cps->count > 1 && cps->linepos + cps->cp[cps->count - 1].offset > pos) cps->count--;
+  }
+
+  for (i = 0; i < WRAP_LINES; i++) {
+    wrap = &ed->wraps.line[i];
+    if (wrap->linepos < 0 || pos > wrap->linepos + wrap->length) continue;
+    if (pos + removed < wrap->linepos) {
+      wrap->linepos += added - removed;
+    } else {
+      wrap->linepos = -1;
+    }
+  }
+
+  for (i = 0; i < WRAP_LINES; i++) {
+    kl = &ed->keyword_lines.line[i];
+    if (kl->linepos < 0 || pos > kl->linepos + kl->length) continue;
+    if (pos + removed < kl->linepos) {
+      kl->linepos += added - removed;
+    } else {
+      kl->linepos = -1;
+    }
+  }
+}
+
+void invalidate_index(struct editor *ed, int pos) {
+  // Trigrams starting up to two bytes before pos read the changed text
+  int chunk = pos < 2 ? 0 : (pos - 2) / TRIGRAM_CHUNK;
+  if (ed->indexed > chunk) ed->indexed = chunk;
+}
+
 void insert(struct editor *ed, int pos, char *buf, int bufsize) {
+  invalidate_layout(ed, pos, 0, bufsize);
+  invalidate_index(ed, pos);
+  ed->parse_from = keep_symbols(&ed->symbols, pos);
+  pool_advance(++ed->generation);
+  preserve_snapshots(ed->content, pos, 0, bufsize);
   // Slide the following text over
   memmove(ed->content + pos + bufsize, ed->content + pos, strlen(ed->content + pos)+1);
   // Overwrite the gap with new text
   memcpy(ed->content + pos, buf, bufsize);
+  resume_snapshots(ed->content);
 }
 
 void erase(struct editor *ed, int pos, int len) {
+  invalidate_layout(ed, pos, len, 0);
+  invalidate_index(ed, pos);
+  ed->parse_from = keep_symbols(&ed->symbols, pos);
+  pool_advance(++ed->generation);
+  preserve_snapshots(ed->content, pos, len, 0);
   memmove(ed->content + pos, ed->content + pos + len, strlen(ed->content + pos + len) + 1);
+  resume_snapshots(ed->content);
 }
 
 void replace(struct editor *ed, int pos, int len, char *buf, int bufsize) {
@@ -127,7 +392,7 @@ void replace(struct editor *ed, int pos, int len, char *buf, int bufsize) {
 
 int get(struct editor *ed, int pos) {
   if (pos >= (int) strlen(ed->content)) return -1;
-  return ed->content[pos];
+  return (unsigned char) ed->content[pos];
 }
 
 char* text_ptr(struct editor *ed, int pos) {
@@ -139,45 +404,261 @@ char* text_ptr(struct editor *ed, int pos) {
 //
 
 int line_length(struct editor *ed, int linepos) {
-	int pos;
-  for (pos = linepos;;pos++) {
-    int ch = get(ed, pos);
-    if (ch < 0 || ch == '\n' || ch == '\r') return pos - linepos;
-  }
+  return strcspn(text_ptr(ed, linepos), "\r\n");
 }
 
 int line_start(struct editor *ed, int pos) {
-  for (; pos > 0 && get(ed, pos - 1) != '\n'; pos--);
+  for (; pos > 0 && ed->content[pos - 1] != '\n'; pos--);
   return pos;
 }
 
+int line_length_max(struct editor *ed, int linepos, int max) {
+  char *p = text_ptr(ed, linepos);
+  int n;
+
+  if (max > MAXSIZE - linepos) max = MAXSIZE - linepos;
+  for (n = 0; n < max; n++) {
+    if (p[n] == '\n' || p[n] == '\r' || p[n] == 0) break;
+  }
+  return n;
+}
+
+int long_line(struct editor *ed, int linepos) {
+ /**
+  * Checks whether a line is too long to be wrapped onto the screen. Such
+  * lines are displayed on a single row scrolled horizontally by the margin.
+  */
+  int limit = ed->cols * ed->lines;
+  return line_length_max(ed, linepos, limit) == limit;
+}
+
 int next_line(struct editor *ed, int pos, int dir) {
-  pos = line_start(ed, pos);
-	
-  if (dir > 0) pos += line_length(ed, pos);
-  
-  pos += dir;
+  char *end;
 
+  if (dir > 0) {
+    end = strchr(text_ptr(ed, pos), '\n');
+    return end ? end - ed->content + 1 : -1;
+  }
+
+  pos = line_start(ed, pos) - 1;
   if (pos < 0) return -1;
-  if ((unsigned int)pos > strlen(ed->content)) { return -1; }
   
   return line_start(ed, pos);
 }
 
-int column(struct editor *ed, int linepos, int col) {
+int line_number(struct editor *ed, int pos) {
+ /**
+  * @return The number of the line pos is on, counting from zero
+  */
+  char *p = ed->content;
+  char *end = ed->content + pos;
+  int line = 0;
+
+  while ((p = memchr(p, '\n', end - p))) {
+    line++;
+    p++;
+  }
+  return line;
+}
+
+struct checkpoint *find_checkpoint(struct editor *ed, int linepos, int col, int screen_col) {
+ /**
+  * Finds the last checkpoint at or before byte offset col, or at or before
+  * screen column screen_col if col is negative. Missing checkpoints are
+  * computed on demand, every CHECKPOINT bytes along the line.
+  */
+  struct checkpoints *cps = &ed->checkpoints;
+  struct checkpoint *last;
+  int lo, hi, mid, offset;
   char *p = text_ptr(ed, linepos);
-  int c = 0;
-  while (col > 0) {
-    if (p == ed->content + MAXSIZE) break;
-    if (*p == '\t') {
-      int spaces = TABSIZE - c % TABSIZE;
-      c += spaces;
+
+  if (cps->linepos != linepos) {
+    cps->linepos = linepos;
+    cps->count = 1;
+    cps->cp[0].offset = cps->cp[0].col = 0;
+  }
+
+  for (;;) {
+    last = &cps->cp[cps->count - 1];
+    if (col >= 0 ? last->offset + CHECKPOINT > col : last->col >= screen_col) break;
+    if (cps->count == MAX_CHECKPOINTS) break;
+
+    if (line_length_max(ed, linepos + last->offset, CHECKPOINT) < CHECKPOINT) break;
+    offset = last->offset + CHECKPOINT;
+    while (linepos + offset < MAXSIZE && utf8_continuation(p[offset])) offset++;
+
+    cps->cp[cps->count].offset = offset;
+    cps->cp[cps->count].col = text_width(p + last->offset, offset - last->offset, last->col, TABSIZE);
+    cps->count++;
+  }
+
+  lo = 0;
+  hi = cps->count - 1;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (col >= 0 ? cps->cp[mid].offset <= col : cps->cp[mid].col <= screen_col) {
+      lo = mid;
     } else {
-      c++;
+      hi = mid - 1;
+    }
+  }
+  return &cps->cp[lo];
+}
+
+int column(struct editor *ed, int linepos, int col) {
+  struct checkpoint *cp = find_checkpoint(ed, linepos, col, 0);
+
+  if (linepos + col > MAXSIZE) col = MAXSIZE - linepos;
+  return text_width(text_ptr(ed, linepos + cp->offset), col - cp->offset, cp->col, TABSIZE);
+}
+
+int column_offset(struct editor *ed, int linepos, int screen_col, int *reached) {
+  struct checkpoint *cp = find_checkpoint(ed, linepos, -1, screen_col);
+  int pos = linepos + cp->offset;
+
+  return cp->offset + text_offset(text_ptr(ed, pos), line_length(ed, pos), cp->col, screen_col, TABSIZE, reached);
+}
+
+struct wrap *get_wrap(struct editor *ed, int linepos) {
+ /**
+  * Looks up where a line is split into screen rows, computing and caching
+  * the rows if the line is not in the cache
+  */
+  struct wraps *wraps = &ed->wraps;
+  struct wrap *wrap;
+  char *p = text_ptr(ed, linepos);
+  int i, n, offset, width;
+
+  if (wraps->cols != ed->cols || wraps->lines != ed->lines) {
+    for (i = 0; i < WRAP_LINES; i++) wraps->line[i].linepos = -1;
+    wraps->cols = ed->cols;
+    wraps->lines = ed->lines;
+  }
+
+  for (i = 0; i < WRAP_LINES; i++) {
+    if (wraps->line[i].linepos == linepos) return &wraps->line[i];
+  }
+
+  wrap = &wraps->line[wraps->next];
+  wraps->next = (wraps->next + 1) % WRAP_LINES;
+
+  wrap->linepos = linepos;
+  wrap->length = line_length(ed, linepos);
+  wrap->longline = long_line(ed, linepos);
+  wrap->rows = 1;
+  wrap->offsets[0] = 0;
+  if (wrap->longline) return wrap;
+
+  offset = 0;
+  while (wrap->rows < MAX_WRAP_ROWS) {
+    n = text_fit(p + offset, wrap->length - offset, ed->cols, TABSIZE, &width);
+    if (width < ed->cols) break;
+    if (n == 0) n = utf8_length(p[offset]);
+    offset += n;
+    wrap->offsets[wrap->rows++] = offset;
+  }
+
+  return wrap;
+}
+
+struct keyword_line *get_keywords(struct editor *ed, int linepos) {
+ /**
+  * Looks up where keywords occur on a line, finding and caching them if the
+  * line is not in the cache
+  */
+  struct keyword_lines *lines = &ed->keyword_lines;
+  struct keyword_line *kl;
+  struct span *spans;
+  int i, size;
+
+  for (i = 0; i < WRAP_LINES; i++) {
+    if (lines->line[i].linepos == linepos) return &lines->line[i];
+  }
+
+  kl = &lines->line[lines->next];
+  lines->next = (lines->next + 1) % WRAP_LINES;
+
+  kl->linepos = linepos;
+  kl->length = line_length(ed, linepos);
+
+  // Spans are at least a byte apart, so a line has room for at most this many
+  size = kl->length / 2 + 1;
+  if (size > kl->size && (spans = realloc(kl->spans, size * sizeof(struct span)))) {
+    kl->spans = spans;
+    kl->size = size;
+  }
+  kl->count = find_keywords(ed->keywords, text_ptr(ed, linepos), kl->length, kl->spans, kl->size);
+  return kl;
+}
+
+int in_keyword(struct keyword_line *kl, int pos, int *span) {
+ /**
+  * Tells whether pos is inside a keyword on the line. Positions must be
+  * asked about in increasing order, starting with span at zero.
+  */
+  int offset = pos - kl->linepos;
+
+  while (*span < kl->count && kl->spans[*span].end <= offset) (*span)++;
+  return *span < kl->count && kl->spans[*span].start <= offset;
+}
+
+int wrap_row(struct wrap *wrap, int col) {
+  int row = 0;
+  while (row + 1 < wrap->rows && wrap->offsets[row + 1] <= col) row++;
+  return row;
+}
+
+int wrap_row_end(struct wrap *wrap, int row) {
+  return row + 1 < wrap->rows ? wrap->offsets[row + 1] : wrap->length;
+}
+
+void scroll_to_cursor(struct editor *ed) {
+ /**
+  * Scrolls down until the row holding the cursor is on the screen, taking
+  * wrapped lines above it into account
+  */
+  int rows, line, pos;
+
+  while (ed->topline < ed->line) {
+    rows = wrap_row(get_wrap(ed, ed->linepos), ed->col) + 1;
+    pos = ed->toppos;
+    for (line = ed->topline; line < ed->line && rows <= ed->lines; line++) {
+      rows += get_wrap(ed, pos)->rows;
+      pos = next_line(ed, pos, 1);
     }
-    col--;
+    if (rows <= ed->lines) break;
+
+    ed->toppos = next_line(ed, ed->toppos, 1);
+    ed->topline++;
+  }
+}
+
+void show_cursor(struct editor *ed) {
+ /**
+  * Scrolls up, down or sideways as far as it takes to bring the cursor on
+  * the screen
+  */
+  int col;
+
+  if (ed->line < ed->topline) {
+    ed->toppos = ed->linepos;
+    ed->topline = ed->line;
+  }
+
+  while (ed->line >= ed->topline + ed->lines) {
+    ed->toppos = next_line(ed, ed->toppos, 1);
+    ed->topline++;
+  }
+  scroll_to_cursor(ed);
+
+  col = column(ed, ed->linepos, ed->col);
+  if (col < ed->margin) {
+    ed->margin = col - col % 4;
+  }
+
+  if (col - ed->margin >= ed->cols) {
+    ed->margin = ((col - ed->cols) / 4 + 1) * 4;
   }
-  return c;
 }
 
 void moveto(struct editor *ed, int pos, int center) {
@@ -236,6 +717,8 @@ void moveto(struct editor *ed, int pos, int center) {
       }
     }
   }
+
+  scroll_to_cursor(ed);
 }
 
 //
@@ -306,11 +789,6 @@ void erase_selection_or_line(struct editor *ed) {
   }
 }
 
-void select_all(struct editor *ed) {
-  ed->anchor = 0;
-  moveto(ed, strlen(ed->content), 0);
-}
-
 //
 // Screen functions
 //
@@ -321,6 +799,305 @@ void get_console_size(struct editor *ed) {
   ioctl(0, TIOCGWINSZ, &ws);
   ed->cols = ws.ws_col;
   ed->lines = ws.ws_row - 1;
+  term_resize(ed->lines + 1, ed->cols);
+}
+
+void redraw_screen(struct editor *ed) {
+  get_console_size(ed);
+  show_cursor(ed);
+}
+
+//
+// Background jobs
+//
+
+void index_text(struct job *job) {
+  char buf[TRIGRAM_CHUNK + 2];
+  struct reindex *reindex = job->data;
+  int chunk, len;
+
+  for (chunk = reindex->first; chunk < reindex->chunks; chunk++) {
+    if (job_cancelled(job)) return;
+    len = read_snapshot(job->snap, chunk * TRIGRAM_CHUNK, buf, sizeof(buf));
+    index_chunk(&reindex->trigrams, buf, len, chunk);
+  }
+}
+
+void text_indexed(struct job *job) {
+  struct editor *ed = job->owner;
+  struct reindex *reindex = job->data;
+
+  merge_trigrams(&ed->trigrams, &reindex->trigrams, reindex->first);
+  ed->indexed = reindex->chunks;
+}
+
+void update_index(struct editor *ed) {
+ /**
+  * Reindexes the chunks from the first one changed since the last time to
+  * the end of a long enough text in the background
+  */
+  struct snapshot *snap;
+  struct reindex *reindex;
+  int length;
+
+  if (ed->reindexed == ed->generation) return;
+  length = strlen(ed->content);
+  if (length < INDEX_MIN) return;
+
+  ed->reindexed = ed->generation;
+  reindex = calloc(1, sizeof(struct reindex));
+  if (!reindex) return;
+  reindex->first = ed->indexed;
+  reindex->chunks = (length + TRIGRAM_CHUNK - 1) / TRIGRAM_CHUNK;
+
+  snap = take_snapshot(ed->content, length, ed->generation);
+  pool_submit(index_text, text_indexed, ed, snap, reindex);
+  release_snapshot(snap);
+}
+
+void parse_text(struct job *job) {
+  struct reparse *reparse = job->data;
+  int len = job->snap->length - reparse->from;
+  char *text = malloc(len + 1);
+
+  if (!text) return;
+  text[read_snapshot(job->snap, reparse->from, text, len)] = 0;
+  if (parse_symbols(&reparse->symbols, text, reparse->from) < 0) reparse->symbols.count = 0;
+  free(text);
+}
+
+void text_parsed(struct job *job) {
+  struct editor *ed = job->owner;
+  struct reparse *reparse = job->data;
+
+  append_symbols(&ed->symbols, &reparse->symbols);
+}
+
+void update_symbols(struct editor *ed) {
+ /**
+  * Parses the text from the last declaration left intact by the edits since
+  * the last time to the end in the background
+  */
+  struct snapshot *snap;
+  struct reparse *reparse;
+
+  if (!ed->has_symbols || ed->reparsed == ed->generation) return;
+  ed->reparsed = ed->generation;
+  reparse = calloc(1, sizeof(struct reparse));
+  if (!reparse) return;
+  reparse->from = ed->parse_from;
+
+  snap = take_snapshot(ed->content, strlen(ed->content), ed->generation);
+  pool_submit(parse_text, text_parsed, ed, snap, reparse);
+  release_snapshot(snap);
+}
+
+uint64_t search_chunks(struct editor *ed, char *search, int slen) {
+ /**
+  * @return A bit for each chunk a match may start in, all of them unless the
+  *         trigram index is up to date
+  */
+  int length = strlen(ed->content);
+
+  if (length < INDEX_MIN || ed->indexed * TRIGRAM_CHUNK < length) return ~(uint64_t) 0;
+  return candidate_chunks(&ed->trigrams, search, slen, ed->any_case);
+}
+
+int chunk_wanted(uint64_t chunks, int pos) {
+  return pos / TRIGRAM_CHUNK >= TRIGRAM_CHUNKS || (chunks >> (pos / TRIGRAM_CHUNK) & 1);
+}
+
+int skip_chunks(uint64_t chunks, int pos, int to, int wanted) {
+ /**
+  * Moves forward over the chunks that are, or are not, wanted
+  * @return The start of the first other chunk, or to
+  */
+  while (pos < to && chunk_wanted(chunks, pos) == wanted) pos = (pos / TRIGRAM_CHUNK + 1) * TRIGRAM_CHUNK;
+  return pos < to ? pos : to;
+}
+
+int skip_chunks_back(uint64_t chunks, int pos, int from, int wanted) {
+ /**
+  * Moves back over the chunks before pos that are, or are not, wanted
+  * @return The end of the first other chunk, or from
+  */
+  while (pos > from && chunk_wanted(chunks, pos - 1) == wanted) pos = (pos - 1) / TRIGRAM_CHUNK * TRIGRAM_CHUNK;
+  return pos > from ? pos : from;
+}
+
+int search_in(char *text, int len, char *search, int slen, int any_case) {
+  return any_case ? search_any_case(text, len, search, slen) : search_text(text, len, search, slen);
+}
+
+void count_matches(struct job *job) {
+  char buf[COUNT_CHUNK + LINEBUF];
+  struct chunk *chunk = job->data;
+  int nlen = strlen(chunk->text);
+  int len, pos, n;
+
+  // Read far enough to see matches that cross into the next chunk
+  len = read_snapshot(job->snap, chunk->start, buf, chunk->end - chunk->start + nlen - 1);
+  for (pos = 0; (n = search_in(buf + pos, len - pos, chunk->text, nlen, chunk->any_case)) >= 0; pos += n + 1) {
+    chunk->offsets[chunk->count++] = chunk->start + pos + n;
+  }
+}
+
+void matches_counted(struct job *job) {
+  struct editor *ed = job->owner;
+  struct matchlist *list = &ed->matchlist;
+  struct chunk *chunk = job->data;
+  int i, total;
+
+  if (chunk->count_id != list->count_id) return;
+  memcpy(list->offsets + chunk->start, chunk->offsets, chunk->count * sizeof(int));
+  list->counts[chunk->start / COUNT_CHUNK] = chunk->count;
+  if (--list->pending) return;
+
+  // Each chunk left its matches at its own start, so they close up in order
+  total = 0;
+  for (i = 0; i * COUNT_CHUNK < MAXSIZE; i++) {
+    memmove(list->offsets + total, list->offsets + i * COUNT_CHUNK, list->counts[i] * sizeof(int));
+    total += list->counts[i];
+  }
+  list->total = total;
+}
+
+void update_match_count(struct editor *ed) {
+ /**
+  * Starts counting the matches of the highlighted text in the background,
+  * a chunk per job, unless they are already counted for this text
+  */
+  struct matchlist *list = &ed->matchlist;
+  struct snapshot *snap;
+  struct chunk *chunk;
+  int length, start;
+
+  if (!ed->matches.length) return;
+  if (list->generation == ed->generation && list->any_case == ed->matches.any_case && !strcmp(list->text, ed->matches.text)) return;
+
+  list->count_id++;
+  list->generation = ed->generation;
+  list->pending = 0;
+  list->total = -1;
+  memset(list->counts, 0, sizeof(list->counts));
+  strcpy(list->text, ed->matches.text);
+  list->any_case = ed->matches.any_case;
+
+  length = strlen(ed->content);
+  snap = take_snapshot(ed->content, length, ed->generation);
+  for (start = 0; start < length; start += COUNT_CHUNK) {
+    chunk = calloc(1, sizeof(struct chunk));
+    if (!chunk) break;
+    chunk->count_id = list->count_id;
+    chunk->start = start;
+    chunk->end = start + COUNT_CHUNK < length ? start + COUNT_CHUNK : length;
+    strcpy(chunk->text, list->text);
+    chunk->any_case = list->any_case;
+    if (pool_submit(count_matches, matches_counted, ed, snap, chunk) < 0) break;
+    list->pending++;
+  }
+  release_snapshot(snap);
+
+  // Without every chunk the count is never complete
+  if (start < length) {
+    list->text[0] = 0;
+    list->count_id++;
+  }
+  if (!list->pending && start >= length) list->total = 0;
+}
+
+struct matchlist *counted_matches(struct editor *ed, char *text) {
+ /**
+  * @return The list of matches of text if counting has finished, or NULL
+  */
+  struct matchlist *list = &ed->matchlist;
+
+  if (list->generation != ed->generation || list->total < 0 || list->any_case != ed->any_case || strcmp(list->text, text)) return NULL;
+  return list;
+}
+
+int match_index(struct matchlist *list, int pos) {
+ /**
+  * @return The index of the first match starting at or after pos
+  */
+  int lo = 0;
+  int hi = list->total;
+  int mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (list->offsets[mid] < pos) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+//
+// Events
+//
+
+void autosave(struct editor *ed) {
+  char name[FILENAME_MAX + sizeof(AUTOSAVE_SUFFIX)];
+  int f, len;
+
+  ed->autosaved = ed->generation;
+  snprintf(name, sizeof(name), "%s" AUTOSAVE_SUFFIX, ed->filename);
+  f = open(name, O_CREAT | O_TRUNC | O_WRONLY, ed->permissions);
+  if (f < 0) return;
+  len = strlen(ed->content);
+  if (write(f, ed->content, len) != len) unlink(name);
+  close(f);
+}
+
+void schedule_autosave(struct editor *ed) {
+  struct itimerspec timer = {{0, 0}, {AUTOSAVE, 0}};
+
+  if (ed->timerfd < 0 || ed->autosave_armed || ed->autosaved == ed->generation) return;
+  timerfd_settime(ed->timerfd, 0, &timer, NULL);
+  ed->autosave_armed = 1;
+}
+
+void remove_autosave(struct editor *ed) {
+  char name[FILENAME_MAX + sizeof(AUTOSAVE_SUFFIX)];
+
+  snprintf(name, sizeof(name), "%s" AUTOSAVE_SUFFIX, ed->filename);
+  unlink(name);
+  ed->autosaved = ed->generation;
+}
+
+int handle_event(struct editor *ed, int key) {
+ /**
+  * Handles a wakeup from something other than the keyboard
+  * @return Non-zero if the screen needs to be redrawn
+  */
+  struct signalfd_siginfo info;
+  uint64_t expirations;
+
+  switch (key) {
+    case KEY_EVENT:
+      // Background results only matter if they are for the current text
+      return pool_collect() > 0;
+
+    case KEY_SIGNAL:
+      if (read(ed->signalfd, &info, sizeof(info)) != sizeof(info)) return 0;
+      if (info.ssi_signo == SIGWINCH) {
+        redraw_screen(ed);
+        return 1;
+      }
+      if (ed->autosaved != ed->generation) autosave(ed);
+      ed->quit = 1;
+      return 0;
+
+    case KEY_TIMER:
+      if (read(ed->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations)) return 0;
+      ed->autosave_armed = 0;
+      if (ed->autosaved != ed->generation) autosave(ed);
+      return 0;
+  }
+  return 0;
 }
 
 //
@@ -328,200 +1105,478 @@ void get_console_size(struct editor *ed) {
 //
 
 void display_message(struct editor *ed, char *fmt, ...) {
+  char msg[LINEBUF];
   va_list args;
 
   va_start(args, fmt);
-  printf(GOTO_LINE_COL, ed->lines + 1, 1);
-  fputs(STATUS_COLOR, stdout);
-  vprintf(fmt, args);
-  fputs(CLREOL TEXT_COLOR, stdout);
-  fflush(stdout);
+  vsnprintf(msg, sizeof(msg), fmt, args);
   va_end(args);
-}
 
-int prompt(struct editor *ed, char *msg, int selection) {
-  int maxlen, len, ch;
-  char *buf = ed->linebuf;
-
-  display_message(ed, msg);
+  term_goto(ed->lines, 0);
+  term_attr(ATTR_STATUS);
+  term_puts(msg);
+  term_cursor_here();
+  term_attr(ATTR_TEXT);
+  term_clear_eol();
+  term_flush();
+}
 
-  len = 0;
-  maxlen = ed->cols - strlen(msg) - 1;
-  if (selection) {
-    len = get_selected_text(ed, buf, maxlen);
-    fwrite(buf, 1, len, stdout);
-  }
+int in_match(struct editor *ed, int pos) {
+ /**
+  * Tells whether pos is inside an occurrence of the highlighted text. Within
+  * a frame positions must be asked about in increasing order, so the search
+  * only ever covers the part of the text that is on screen.
+  */
+  struct matches *m = &ed->matches;
+  int from, len, n;
 
+  if (!m->length) return 0;
   for (;;) {
-    fflush(stdout);
-    ch = get_key();
-    if (ch == KEY_ESC) {
+    if (m->next >= 0) {
+      if (pos < m->next + m->length) return pos >= m->next;
+      m->checked = m->next + m->length;
+      m->next = -1;
+    }
+    if (m->checked > pos) return 0;
+
+    from = pos - m->length + 1;
+    if (from < m->checked) from = m->checked;
+    len = m->textlen - from;
+    if (len > MATCH_WINDOW) len = MATCH_WINDOW;
+    if (len < m->length) {
+      m->checked = MAXSIZE;
       return 0;
-    } else if (ch == KEY_ENTER) {
-      buf[len] = 0;
-      return len > 0;
-    } else if (ch == KEY_BACKSPACE) {
-      if (len > 0) {
-        fputs("\b \b", stdout);
-        len--;
-      }
-    } else if (ch >= ' ' && ch < 0x100 && len < maxlen) {
-      putchar(ch);
-      buf[len++] = ch;
+    }
+
+    n = search_in(ed->content + from, len, m->text, m->length, m->any_case);
+    if (n >= 0) {
+      m->next = from + n;
+    } else {
+      m->checked = from + len - m->length + 1;
     }
   }
 }
 
-int ask() {
-  int ch = getchar();
-  return ch == 'y' || ch == 'Y';
+void highlight(struct editor *ed, char *text) {
+  struct matches *m = &ed->matches;
+
+  m->any_case = ed->any_case;
+  m->length = text ? strlen(text) : 0;
+  if (m->length >= LINEBUF) m->length = 0;
+  if (m->length) memmove(m->text, text, m->length + 1);
+}
+
+void match_status(struct editor *ed, char *buf) {
+  // Shows which match is selected out of how many, e.g. 3/17
+  struct matchlist *list = counted_matches(ed, ed->matches.text);
+  int selstart, selend, i;
+
+  if (!ed->matches.length) {
+    buf[0] = 0;
+  } else if (!list) {
+    strcpy(buf, "?/?");
+  } else {
+    get_selection(ed, &selstart, &selend);
+    i = match_index(list, selstart);
+    if (i < list->total && list->offsets[i] == selstart && selend - selstart == ed->matches.length) {
+      sprintf(buf, "%d/%d", i + 1, list->total);
+    } else {
+      sprintf(buf, "-/%d", list->total);
+    }
+  }
 }
 
 void draw_full_statusline(struct editor *ed) {
-  int namewidth = ed->cols - 36;
-  printf(GOTO_LINE_COL, ed->lines + 1, 1);
-  sprintf(ed->linebuf, STATUS_COLOR "%*.*s  SLn %-3d SCol %-3d Ln %-6dCol %-4d" CLREOL TEXT_COLOR, -namewidth, namewidth, ed->filename, ed->cursor_screen_line, ed->cursor_screen_col, ed->line + 1, column(ed, ed->linepos, ed->col) + 1);
-  fputs(ed->linebuf, stdout);
+  char matches[32];
+  char info[128];
+  char counters[32];
+  int namelen = strlen(ed->filename);
+  int namewidth, len;
+
+  match_status(ed, matches);
+  len = sprintf(info, " %11s  SLn %-3d SCol %-3d Ln %-6dCol %-4d", matches, ed->cursor_screen_line, ed->cursor_screen_col, ed->line + 1, column(ed, ed->linepos, ed->col) + 1);
+
+  // The name comes first. The output and typeahead counters are only shown
+  // when there is room left for them.
+  sprintf(counters, " Out %-5d Keys %-3d", term_frame_bytes, key_backlog());
+  if (namelen + len + (int) strlen(counters) <= ed->cols) strcat(info, counters);
+
+  namewidth = ed->cols - (int) strlen(info);
+  if (namewidth < namelen) namewidth = namelen < ed->cols ? namelen : ed->cols;
+  if (namewidth < 0) namewidth = 0;
+  snprintf(ed->linebuf, LINEBUF, "%*.*s%s", -namewidth, namewidth, ed->filename, info);
+  term_goto(ed->lines, 0);
+  term_attr(ATTR_STATUS);
+  term_puts(ed->linebuf);
+  term_attr(ATTR_TEXT);
+  term_clear_eol();
 }
 
-unsigned int display_line(struct editor *ed, int pos, int fullline) {
+unsigned int display_line(struct editor *ed, int row, int pos, int col, int *width) {
  /**
-  * Displays a line on the screen
-  * @return The number of characters printed, or zero if we printed the full line
+  * Displays a line on a screen row, leaving the first col screen columns blank
+  * @return The number of bytes displayed, or zero if we displayed the full line
   */
-  int hilite = 0;
-  int col = 0;
   int maxcol = ed->cols;
-  char *bufptr = ed->linebuf;
+  int wrapped = 0;
   char *p = text_ptr(ed, pos);
-  int selstart, selend, ch;
-  char *s;
+  int start = pos;
+  struct keyword_line *kl = NULL;
+  int span = 0;
+  int selstart, selend, ch, cp, len, w;
 
   get_selection(ed, &selstart, &selend);
+  if (ed->keywords) kl = get_keywords(ed, line_start(ed, pos));
+  term_goto(row, 0);
+  term_clear_eol();
+  term_goto(row, col);
+
   while (col < maxcol) {
-    if (!hilite && pos >= selstart && pos < selend) {
-      for (s = SELECT_COLOR; *s; s++) *bufptr++ = *s;
-      hilite = 1;
-    } else if (hilite && pos >= selend) {
-      for (s = TEXT_COLOR; *s; s++) *bufptr++ = *s;
-      hilite = 0;
+    if (pos >= selstart && pos < selend) {
+      term_attr(ATTR_SELECT);
+    } else {
+      term_attr(in_match(ed, pos) ? ATTR_MATCH : kl && in_keyword(kl, pos, &span) ? ATTR_KEYWORD : ATTR_TEXT);
     }
 
     if (p == ed->content + MAXSIZE) break;
-    ch = *p;
+    ch = (unsigned char) *p;
     if (ch == '\r' || ch == '\n' || ch == 0) break;
 
+    len = 1;
     if (ch == '\t') {
       int spaces = TABSIZE - col % TABSIZE;
       while (spaces > 0 && col < maxcol) {
-        *bufptr++ = ' ';
+        term_put(" ", 1, 1);
         col++;
         spaces--;
       }
+    } else if (ch < 0x80) {
+      term_put(p, 1, 1);
+      col++;
     } else {
-      *bufptr++ = ch;
+      len = utf8_decode(p, ed->content + MAXSIZE - p, &cp);
+      w = char_width(cp);
+      if (col + w > maxcol) {
+        wrapped = 1;
+        break;
+      }
+      term_put(p, len, w);
+      col += w;
+    }
+
+    p += len;
+    pos += len;
+  }
+
+  // A selection running past the end of the row is shown up to the edge
+  if (pos >= selstart && pos < selend) {
+    term_attr(ATTR_SELECT);
+    while (col < maxcol) {
+      term_put(" ", 1, 1);
       col++;
     }
+  }
+  term_attr(ATTR_TEXT);
 
-    p++;
-    pos++;
+  *width = col;
+  if (col == maxcol || wrapped) {
+    return pos - start;
+  } else {
+    return 0;
   }
+}
+
+void draw_screen(struct editor *ed) {
+  int screen_line, width, col, start;
+  int row = 0;
+  int line = ed->topline;
+  int pos = ed->toppos;
+  struct wrap *wrap;
+
+  ed->matches.textlen = strlen(ed->content);
+  ed->matches.next = -1;
+  ed->matches.checked = 0;
+
+  for (screen_line = 1; screen_line <= ed->lines; screen_line++) {
+    if (pos < 0) {
+      term_goto(screen_line - 1, 0);
+      term_clear_eol();
+      continue;
+    }
+
+    wrap = get_wrap(ed, pos);
+    start = pos + wrap->offsets[row];
+    if (wrap->longline && line == ed->line) {
+      start += column_offset(ed, pos, ed->margin, &col);
+      display_line(ed, screen_line - 1, start, col - ed->margin, &width);
+    } else {
+      display_line(ed, screen_line - 1, start, 0, &width);
+    }
+
+    if (line == ed->line && row == wrap_row(wrap, ed->col)) {
+      ed->cursor_screen_line = screen_line;
+      if (wrap->longline) {
+        ed->cursor_screen_col = column(ed, pos, ed->col) - ed->margin + 1;
+      } else {
+        ed->cursor_screen_col = text_width(text_ptr(ed, start), ed->col - wrap->offsets[row], 0, TABSIZE) + 1;
+      }
+    }
+
+    if (++row == wrap->rows) {
+      line++;
+      pos = next_line(ed, pos, 1);
+      row = 0;
+    }
+  }
+}
+
+void position_cursor(struct editor *ed) {
+  term_cursor(ed->cursor_screen_line - 1, ed->cursor_screen_col - 1);
+}
+
+void draw_finder(struct editor *ed) {
+ /**
+  * Lists the best lines over the bottom of the text, the best one lowest
+  */
+  struct finder *finder = &ed->finder;
+  int rows = finder->best.count < ed->lines / 2 ? finder->best.count : ed->lines / 2;
+  int i, row, pos, width;
+  char number[16];
+
+  // Rows no longer covered get their text back
+  if (rows < finder->shown) draw_screen(ed);
+  finder->shown = rows;
+
+  for (i = 0; i < rows; i++) {
+    pos = finder->best.hits[i].pos;
+    row = ed->lines - 1 - i;
+    ed->matches.next = -1;
+    ed->matches.checked = 0;
+    display_line(ed, row, pos, 8, &width);
+
+    sprintf(number, "%7d ", line_number(ed, pos) + 1);
+    term_goto(row, 0);
+    term_attr(i == finder->selected ? ATTR_MATCH : ATTR_STATUS);
+    term_puts(number);
+    term_attr(ATTR_TEXT);
+  }
+}
+
+void pick_result(struct editor *ed, int step) {
+  struct finder *finder = &ed->finder;
+
+  if (!finder->shown) return;
+  finder->selected = (finder->selected + step + finder->shown) % finder->shown;
+  draw_finder(ed);
+}
+
+void close_finder(struct editor *ed) {
+  struct finder *finder = &ed->finder;
+
+  finder->query_id++;
+  finder->pending = 0;
+  finder->query[0] = 0;
+  finder->best.count = 0;
+  finder->shown = 0;
+}
 
-  if (hilite) {
-    while (col < maxcol) {
-      *bufptr++ = ' ';
-      col++;
-    }
-  } else {
-    if (col == 0) *bufptr++ = ' ';
+void score_chunk(struct job *job) {
+  char buf[SCORE_CHUNK + LINEBUF];
+  struct scoring *scoring = job->data;
+  int from = scoring->start > 0 ? scoring->start - 1 : 0;
+  char *line = buf;
+  int len;
+
+  // Read on past the chunk to the end of its last line, within reason
+  len = read_snapshot(job->snap, from, buf, scoring->end - from + LINEBUF);
+  if (scoring->start > 0) {
+    line = memchr(buf, '\n', scoring->end - from);
+    if (!line) return;
+    line++;
   }
+  score_lines(&scoring->best, line, len - (line - buf), scoring->end - from - (line - buf), from + (line - buf), scoring->query);
+}
 
-  if (col < maxcol) {
-    for (s = CLREOL; *s; s++) *bufptr++ = *s;
-  }
+void lines_scored(struct job *job) {
+  struct editor *ed = job->owner;
+  struct finder *finder = &ed->finder;
+  struct scoring *scoring = job->data;
 
-  if (fullline) {
-    memcpy(bufptr, "\r\n", 2);
-    bufptr += 2;
-  }
+  if (scoring->query_id != finder->query_id) return;
+  merge_best(&finder->best, &scoring->best);
+  if (--finder->pending) return;
+  sort_best(&finder->best);
+  draw_finder(ed);
+}
 
-  if (hilite) {
-    for (s = TEXT_COLOR; *s; s++) *bufptr++ = *s;
+void update_finder(struct editor *ed, char *query) {
+ /**
+  * Starts scoring every line against query in the background, a chunk of
+  * lines per job, and lists the best ones once all chunks are in
+  */
+  struct finder *finder = &ed->finder;
+  struct snapshot *snap;
+  struct scoring *scoring;
+  int length, start;
+
+  finder->query_id++;
+  finder->pending = 0;
+  finder->selected = 0;
+  finder->best.count = 0;
+  strcpy(finder->query, query);
+
+  length = strlen(ed->content);
+  snap = take_snapshot(ed->content, length, ed->generation);
+  for (start = 0; start < length; start += SCORE_CHUNK) {
+    scoring = calloc(1, sizeof(struct scoring));
+    if (!scoring) break;
+    scoring->query_id = finder->query_id;
+    scoring->start = start;
+    scoring->end = start + SCORE_CHUNK < length ? start + SCORE_CHUNK : length;
+    strcpy(scoring->query, query);
+    if (pool_submit(score_chunk, lines_scored, ed, snap, scoring) < 0) break;
+    finder->pending++;
   }
+  release_snapshot(snap);
 
-  fwrite(ed->linebuf, 1, bufptr - ed->linebuf, stdout);
-
-  if(col == maxcol) {
-    return maxcol;
-  } else {
-    return 0;
+  // Without every chunk the lines are scored here instead
+  if (start < length) {
+    finder->query_id++;
+    finder->pending = 0;
+    score_lines(&finder->best, ed->content, length, length, 0, query);
+  }
+  if (!finder->pending) {
+    sort_best(&finder->best);
+    draw_finder(ed);
   }
 }
 
-void draw_screen(struct editor *ed) {
-  int screen_line, bytes_written, col = 0;
-  int line = ed->topline;
-  int cursor_col = column(ed, ed->linepos, ed->col);
-  int pos = ed->toppos;
+int prompt(struct editor *ed, char *msg, int selection, void (*changed)(struct editor *ed, char *text)) {
+ /**
+  * Reads a line of text into ed->linebuf. If given, changed is called with
+  * the text whenever it has been edited and no more keys are waiting, Tab
+  * switches whether the search ignores case, and Up and Down pick one of
+  * the lines the finder lists.
+  * @return Nonzero if the text was entered, zero on Esc
+  */
+  int maxlen, len, ch;
+  int edited = 0;
+  char *buf = ed->linebuf;
 
-  printf(GOTO_LINE_COL, 1, 1);
-  fputs(TEXT_COLOR, stdout);
+  len = 0;
+  maxlen = ed->cols - strlen(msg) - (changed ? 12 : 1);
+  if (selection) {
+    len = get_selected_text(ed, buf, maxlen);
+  }
 
-  for (screen_line = 1; screen_line <= ed->lines; screen_line++) {
-    if (pos < 0) {
-      fputs(CLREOL "\r\n", stdout);
-    } else {
-      bytes_written = display_line(ed, pos, 1);
-      if (line == ed->line && col <= cursor_col) {
-        ed->cursor_screen_line = screen_line;
-        ed->cursor_screen_col = cursor_col - col + 1;
+  for (;;) {
+    buf[len] = 0;
+    if (edited && changed && !key_pending()) {
+      changed(ed, buf);
+      edited = 0;
+    }
+    display_message(ed, "%s%s%s", msg, changed && ed->any_case ? "(any case) " : "", buf);
+    ch = get_key();
+    if (ch == KEY_ESC) {
+      return 0;
+    } else if (ch == KEY_ENTER) {
+      if (edited && changed) changed(ed, buf);
+      return len > 0;
+    } else if (ch == KEY_BACKSPACE) {
+      if (len > 0) {
+        do {
+          len--;
+        } while (len > 0 && utf8_continuation(buf[len]));
+        edited = 1;
       }
-      if (bytes_written) {
-        pos += bytes_written;
-        col += bytes_written;
-      } else {
-        line += 1;
-        pos = next_line(ed, pos, 1);
-        col = 0;
+    } else if (ch == KEY_TAB && changed) {
+      ed->any_case = !ed->any_case;
+      edited = 1;
+    } else if ((ch == KEY_UP || ch == KEY_DOWN) && changed) {
+      pick_result(ed, ch == KEY_UP ? 1 : -1);
+    } else if (ch >= ' ' && ch < 0x80 && len < maxlen) {
+      buf[len++] = ch;
+      edited = 1;
+    } else if (ch >= unicode(0x80) && len < maxlen - 4) {
+      len += utf8_encode(unicode_char(ch), buf + len);
+      edited = 1;
+    } else if (ch == KEY_EVENT || ch == KEY_SIGNAL || ch == KEY_TIMER) {
+      handle_event(ed, ch);
+      if (ed->quit) return 0;
+      maxlen = ed->cols - strlen(msg) - (changed ? 12 : 1);
+      if (len > maxlen) len = maxlen > 0 ? maxlen : 0;
+    } else if (ch == KEY_PASTE) {
+      int pastelen, i;
+      char *text = get_paste(&pastelen);
+      for (i = 0; i < pastelen && len < maxlen && (unsigned char) text[i] >= ' '; i++) buf[len++] = text[i];
+      while (i < pastelen && i > 0 && len > 0 && utf8_continuation(text[i])) {
+        len--;
+        i--;
       }
+      edited = 1;
     }
   }
 }
 
-void position_cursor(struct editor *ed) {
-  printf(GOTO_LINE_COL, ed->cursor_screen_line, ed->cursor_screen_col);
+int ask(struct editor *ed) {
+  int ch;
+
+  do {
+    ch = get_key();
+    if (ch == KEY_EVENT || ch == KEY_SIGNAL || ch == KEY_TIMER) {
+      handle_event(ed, ch);
+      if (ed->quit) return 0;
+      ch = KEY_UNKNOWN;
+    }
+  } while (ch == KEY_UNKNOWN);
+  return ch == 'y' || ch == 'Y';
 }
 
 //
-// Cursor movement
+// Progress
 //
 
-void adjust(struct editor *ed) {
-  int col, ll;
+long long now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
-  if (ed->line < ed->topline) {
-    ed->toppos = ed->linepos;
-    ed->topline = ed->line;
-  }
+void begin_progress(struct progress *progress, char *what) {
+  progress->what = what;
+  progress->next = now_ms() + slice_ms;
+}
 
-  while (ed->line >= ed->topline + ed->lines) {
-    ed->toppos = next_line(ed, ed->toppos, 1);
-    ed->topline++;
-  }
+int keep_going(struct editor *ed, struct progress *progress, int done, int total) {
+ /**
+  * Called between slices of a long operation. Once a slice of time has
+  * passed, shows how far the operation has come and checks for Esc. The
+  * first slice always runs.
+  * @return Zero if the operation was interrupted
+  */
+  if (done == 0 || now_ms() < progress->next) return 1;
+
+  display_message(ed, "%s... %d%% (Esc to stop)", progress->what, total > 0 ? (int) (100LL * done / total) : 0);
+  progress->next = now_ms() + slice_ms;
+
+  // Other typeahead stays queued for when the operation is done
+  if (peek_key() != KEY_ESC) return 1;
+  get_key();
+  return 0;
+}
+
+//
+// Cursor movement
+//
+
+void adjust(struct editor *ed) {
+  int ll;
 
   ll = line_length(ed, ed->linepos);
   ed->col = ed->lastcol;
   if (ed->col > ll) ed->col = ll;
-
-  col = column(ed, ed->linepos, ed->col);
-  while (col < ed->margin) {
-    ed->margin -= 4;
-    if (ed->margin < 0) ed->margin = 0;
-  }
-
-  while (col - ed->margin >= ed->cols) {
-    ed->margin += 4;
-  }
+  while (ed->col > 0 && utf8_continuation(get(ed, ed->linepos + ed->col))) ed->col--;
+  show_cursor(ed);
 }
 
 int sign(int x) {
@@ -545,10 +1600,70 @@ void down(struct editor *ed, int select, int lines) {
   adjust(ed);
 }
 
+void down_rows(struct editor *ed, int select, int rows) {
+ /**
+  * Moves the cursor by screen rows rather than lines, so that wrapped lines
+  * can be navigated one row at a time
+  */
+  struct wrap *wrap;
+  int row, start, end, newpos, reached;
+
+  update_selection(ed, select);
+
+  wrap = get_wrap(ed, ed->linepos);
+  row = wrap_row(wrap, ed->col);
+  if (ed->goalpos != ed->linepos + ed->col) {
+    start = wrap->longline ? 0 : wrap->offsets[row];
+    ed->goal = text_width(text_ptr(ed, ed->linepos + start), ed->col - start, 0, TABSIZE);
+  }
+
+  row += rows;
+  while (row < 0) {
+    newpos = next_line(ed, ed->linepos, -1);
+    if (newpos < 0) {
+      row = 0;
+      break;
+    }
+    ed->linepos = newpos;
+    ed->line--;
+    wrap = get_wrap(ed, ed->linepos);
+    row += wrap->rows;
+  }
+
+  while (row >= wrap->rows) {
+    newpos = next_line(ed, ed->linepos, 1);
+    if (newpos < 0) {
+      row = wrap->rows - 1;
+      break;
+    }
+    row -= wrap->rows;
+    ed->linepos = newpos;
+    ed->line++;
+    wrap = get_wrap(ed, ed->linepos);
+  }
+
+  start = wrap->offsets[row];
+  end = wrap_row_end(wrap, row);
+  ed->col = start + text_offset(text_ptr(ed, ed->linepos + start), end - start, 0, ed->goal, TABSIZE, &reached);
+
+  // The end of a wrapped row is the start of the next one
+  if (ed->col == end && row + 1 < wrap->rows && ed->col > start) {
+    do {
+      ed->col--;
+    } while (ed->col > start && utf8_continuation(get(ed, ed->linepos + ed->col)));
+  }
+
+  ed->lastcol = ed->col;
+  adjust(ed);
+  ed->goalpos = ed->linepos + ed->col;
+}
+
 void left(struct editor *ed, int select) {
   update_selection(ed, select);
   if (ed->col > 0) {
-    ed->col--;
+    do {
+      ed->col--;
+    } while (ed->col > 0 && utf8_continuation(get(ed, ed->linepos + ed->col)));
   } else {
     int newpos = next_line(ed, ed->linepos, -1);
     if (newpos < 0) return;
@@ -565,7 +1680,9 @@ void left(struct editor *ed, int select) {
 void right(struct editor *ed, int select) {
   update_selection(ed, select);
   if (ed->col < line_length(ed, ed->linepos)) {
-    ed->col++;
+    do {
+      ed->col++;
+    } while (utf8_continuation(get(ed, ed->linepos + ed->col)));
   } else {
     int newpos = next_line(ed, ed->linepos, 1);
     if (newpos < 0) return;
@@ -580,7 +1697,7 @@ void right(struct editor *ed, int select) {
 }
 
 int wordchar(int ch) {
-  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9');
+  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch >= 0x80;
 }
 
 void wordleft(struct editor *ed, int select) {
@@ -652,14 +1769,44 @@ void end(struct editor *ed, int select) {
 // Text editing
 //
 
-void insert_char(struct editor *ed, char ch) {
+void insert_text(struct editor *ed, char *buf, int len) {
   erase_selection(ed);
-  insert(ed, ed->linepos + ed->col, &ch, 1);
-  ed->col++;
+  insert(ed, ed->linepos + ed->col, buf, len);
+  ed->col += len;
   ed->lastcol = ed->col;
   adjust(ed);
 }
 
+void insert_char(struct editor *ed, char ch) {
+  insert_text(ed, &ch, 1);
+}
+
+int printable(int key) {
+  return (key >= ' ' && key < 0x7F) || key >= unicode(0x80);
+}
+
+void insert_typed(struct editor *ed, int key) {
+ /**
+  * Inserts a typed character together with the printable keys queued
+  * behind it, so that a burst of typing is a single insert
+  */
+  char *buf = ed->linebuf;
+  int len = 0;
+
+  for (;;) {
+    if (key < 0x80) {
+      buf[len++] = key;
+    } else {
+      len += utf8_encode(unicode_char(key), buf + len);
+    }
+    key = peek_key();
+    if (!printable(key) || len > LINEBUF - 4) break;
+    get_key();
+  }
+
+  insert_text(ed, buf, len);
+}
+
 void newline(struct editor *ed) {
   insert(ed, ed->linepos + ed->col, "\n", 1);
 
@@ -675,7 +1822,7 @@ void del(struct editor *ed) {
   ch = get(ed, pos);
   if (ch < 0) return;
 
-  erase(ed, pos, 1);
+  erase(ed, pos, utf8_decode(text_ptr(ed, pos), MAXSIZE - pos, &ch));
   if (ch == '\r') {
     ch = get(ed, pos);
     if (ch == '\n') erase(ed, pos, 1);
@@ -690,6 +1837,7 @@ void backspace(struct editor *ed) {
 }
 
 void indent(struct editor *ed, char *indentation) {
+  struct progress progress;
   int start, end, i, lines, toplines, newline, ch;
   char *p;
   int buflen;
@@ -701,10 +1849,12 @@ void indent(struct editor *ed, char *indentation) {
     return;
   }
 
+  begin_progress(&progress, "Indenting");
   lines = 0;
   toplines = 0;
   newline = 1;
   for (i = start; i < end; i++) {
+    if ((i - start) % SLICE_BYTES == 0 && !keep_going(ed, &progress, i - start, (end - start) * 2)) return;
     if (i == ed->toppos) toplines = lines;
     if (newline) {
       lines++;
@@ -717,6 +1867,7 @@ void indent(struct editor *ed, char *indentation) {
   newline = 1;
   p = ed->tmpbuf;
   for (i = start; i < end; i++) {
+    if ((i - start) % SLICE_BYTES == 0 && !keep_going(ed, &progress, end - start + i - start, (end - start) * 2)) return;
     if (newline) {
       memcpy(p, indentation, width);
       p += width;
@@ -845,6 +1996,32 @@ void paste_selection(struct editor *ed) {
   }
 }
 
+void paste_text(struct editor *ed) {
+ /**
+  * Inserts text pasted through the terminal as a single edit. Newlines are
+  * inserted as they are rather than acting like the Enter key.
+  */
+  char *text;
+  int len, room, i, n, pos;
+
+  text = get_paste(&len);
+  erase_selection(ed);
+
+  // Terminals send newlines as carriage returns
+  room = MAXSIZE - 1 - strlen(ed->content);
+  for (i = n = 0; i < len && n < room; i++) {
+    if (text[i] == 0) continue;
+    if (text[i] == '\r' && i + 1 < len && text[i + 1] == '\n') continue;
+    ed->tmpbuf[n++] = text[i] == '\r' ? '\n' : text[i];
+  }
+  if (i < len) putchar('\007');
+
+  pos = ed->linepos + ed->col;
+  insert(ed, pos, ed->tmpbuf, n);
+  moveto(ed, pos + n, 0);
+  ed->lastcol = ed->col;
+}
+
 void duplicate_selection_or_line(struct editor *ed) {
   int selstart, selend, sellen;
   
@@ -868,76 +2045,364 @@ void save_editor(struct editor *ed) {
   if (rc < 0) {
     display_message(ed, "Error saving document");
     sleep(5);
+  } else {
+    remove_autosave(ed);
+  }
+}
+
+void recover_autosave(struct editor *ed) {
+ /**
+  * Offers to bring back the changes an earlier session autosaved but never
+  * saved. They are discarded if the offer is turned down.
+  */
+  char name[FILENAME_MAX + sizeof(AUTOSAVE_SUFFIX)];
+  char *text;
+  int f, len;
+
+  snprintf(name, sizeof(name), "%s" AUTOSAVE_SUFFIX, ed->filename);
+  draw_screen(ed);
+  display_message(ed, "Recover unsaved changes from %s? (y/n)", name);
+  if (!ask(ed)) {
+    if (!ed->quit) remove_autosave(ed);
+    return;
+  }
+
+  f = open(name, O_RDONLY | O_BINARY);
+  if (f < 0) return;
+  text = malloc(MAXSIZE);
+  len = text ? read(f, text, MAXSIZE - 1) : -1;
+  close(f);
+  if (len >= 0) {
+    replace(ed, 0, strlen(ed->content), text, len);
+    moveto(ed, 0, 0);
+    ed->lastcol = ed->col;
+  }
+  free(text);
+}
+
+int find_match(struct editor *ed, int start, char *search, int slen, struct progress *progress) {
+ /**
+  * Searches from start to the end and then wraps around to start, a slice at
+  * a time overlapping by the length of the search text. Chunks the trigram
+  * index rules out are skipped.
+  * @return The position of the match, -1 if there is none, or -2 if interrupted
+  */
+  uint64_t chunks = search_chunks(ed, search, slen);
+  int match = -1;
+  int pos, end, len, length, pass, from, to, done;
+
+  length = strlen(ed->content);
+  done = 0;
+  for (pass = 0; pass < 2 && match < 0; pass++) {
+    from = pass ? 0 : start;
+    to = pass ? start + slen - 1 : length;
+    if (to > length) to = length;
+    for (pos = from; match < 0; pos = end) {
+      pos = skip_chunks(chunks, pos, to, 0);
+      if (pos >= to) break;
+      if (!keep_going(ed, progress, done + pos - from, length)) return -2;
+      end = skip_chunks(chunks, pos, to, 1);
+      if (end > pos + SLICE_BYTES) end = pos + SLICE_BYTES;
+      len = end + slen - 1 < to ? end + slen - 1 - pos : to - pos;
+      match = search_in(ed->content + pos, len, search, slen, ed->any_case);
+      if (match >= 0) match += pos;
+    }
+    done = length - start;
+  }
+
+  return match;
+}
+
+int find_match_backward(struct editor *ed, int start, char *search, int slen, struct progress *progress) {
+ /**
+  * Searches backwards for a match starting before start and then wraps
+  * around to the end, a slice at a time from the end of each range. Chunks
+  * the trigram index rules out are skipped.
+  * @return The position of the match, -1 if there is none, or -2 if interrupted
+  */
+  uint64_t chunks = search_chunks(ed, search, slen);
+  int match = -1;
+  int pos, lo, hi, length, pass, from, to, done;
+
+  length = strlen(ed->content);
+  done = 0;
+  for (pass = 0; pass < 2 && match < 0; pass++) {
+    // Matches starting from from up to to
+    from = pass ? start : 0;
+    to = pass ? length : start;
+    for (pos = to; match < 0; pos = lo) {
+      pos = skip_chunks_back(chunks, pos, from, 0);
+      if (pos <= from) break;
+      if (!keep_going(ed, progress, done + to - pos, length)) return -2;
+      lo = skip_chunks_back(chunks, pos, from, 1);
+      if (lo < pos - SLICE_BYTES) lo = pos - SLICE_BYTES;
+      hi = pos + slen - 1 < length ? pos + slen - 1 : length;
+      match = search_last(ed->content + lo, hi - lo, search, slen, ed->any_case);
+      if (match >= 0) match += lo;
+    }
+    done = start;
+  }
+
+  return match;
+}
+
+void find_as_you_type(struct editor *ed, char *search) {
+  // Every change to the search text searches again from where Find started
+  struct progress progress;
+  int slen = strlen(search);
+  int match = -1;
+
+  highlight(ed, search);
+  if (slen > 0) {
+    begin_progress(&progress, "Searching");
+    if (ed->search_backward) {
+      match = find_match_backward(ed, ed->search_origin, search, slen, &progress);
+    } else {
+      match = find_match(ed, ed->search_origin, search, slen, &progress);
+    }
+  }
+
+  if (match >= 0) {
+    ed->anchor = match;
+    moveto(ed, match + slen, 1);
+  } else {
+    ed->anchor = -1;
+    moveto(ed, ed->search_origin, 0);
   }
+  draw_screen(ed);
 }
 
-void find_text(struct editor *ed, char* search) {
-  int slen, selstart, selend;
+void find_text(struct editor *ed, char* search, int backward) {
+ /**
+  * Selects the next match of search after the cursor, or the one before the
+  * selection or cursor when going backward, wrapping around at either end
+  */
+  struct progress progress;
+  struct matchlist *list;
+  int slen, selstart, selend, start, anchor, toppos, topline, match, i;
 
   if (!search) {
     search = ed->tmpbuf;
     if (!get_selection(ed, &selstart, &selend)) {
-      if (!prompt(ed, "Find: ", 1)) {
-        return;
-      }    
-      strncpy(search, ed->linebuf, strlen(ed->linebuf));
+      // The prompt moves to the first match as the search text is typed
+      ed->search_origin = ed->linepos + ed->col;
+      ed->search_backward = backward;
+      anchor = ed->anchor;
+      toppos = ed->toppos;
+      topline = ed->topline;
+      if (!prompt(ed, backward ? "Find backwards: " : "Find: ", 1, find_as_you_type)) {
+        // Esc goes back to where the search started
+        highlight(ed, NULL);
+        moveto(ed, ed->search_origin, 0);
+        ed->anchor = anchor;
+        ed->toppos = toppos;
+        ed->topline = topline;
+      } else if (ed->anchor < 0) {
+        putchar('\007');
+      }
+      return;
     } else {
-      strncpy(search, ed->content + selstart, selend - selstart);
+      memcpy(search, ed->content + selstart, selend - selstart);
+      search[selend - selstart] = 0;
     }
   }
   
   slen = strlen(search);
+  start = ed->linepos + ed->col;
+  if (backward && get_selection(ed, &selstart, &selend)) start = selstart;
 
   if (slen > 0) {
-    char *match;
-    
-    match = strstr(ed->content + ed->linepos + ed->col, search);
-    if (match != NULL) {
-      int pos = match - ed->content;
-      ed->anchor = pos;
-      moveto(ed, pos + slen, 1);
+    highlight(ed, search);
+    list = counted_matches(ed, search);
+    if (list && backward) {
+      i = match_index(list, start);
+      match = list->total ? list->offsets[i > 0 ? i - 1 : list->total - 1] : -1;
+    } else if (list) {
+      i = match_index(list, start);
+      match = list->total ? list->offsets[i < list->total ? i : 0] : -1;
     } else {
+      begin_progress(&progress, "Searching");
+      if (backward) {
+        match = find_match_backward(ed, start, search, slen, &progress);
+      } else {
+        match = find_match(ed, start, search, slen, &progress);
+      }
+    }
+
+    if (match >= 0) {
+      ed->anchor = match;
+      moveto(ed, match + slen, 1);
+    } else if (match == -1) {
       putchar('\007');
     }
   }
 }
 
-void goto_line(struct editor *ed, int lineno) {
-  int l, pos, new_pos;
+int next_regex_match(struct regex *re, char *text, int length, int pos, int *end) {
+  // Empty matches would leave the cursor where it is
+  while ((pos = regex_search(re, text, length, pos, end)) >= 0 && *end == pos) pos++;
+  return pos;
+}
 
-  ed->anchor = -1;
-  if (!lineno && prompt(ed, "Goto line: ", 1)) {
-    lineno = atoi(ed->linebuf);
+void find_regex(struct editor *ed, char *pattern) {
+  struct regex *re = regex_compile(pattern);
+  int length = strlen(ed->content);
+  int start = ed->linepos + ed->col;
+  int pos, end;
+
+  if (!re) {
+    putchar('\007');
+    return;
+  }
+
+  // Search from the cursor to the end and then wrap around to the top
+  pos = next_regex_match(re, ed->content, length, start, &end);
+  if (pos < 0) {
+    pos = next_regex_match(re, ed->content, length, 0, &end);
+    if (pos >= start) pos = -1;
   }
+  regex_free(re);
+
+  if (pos >= 0) {
+    ed->anchor = pos;
+    moveto(ed, end, 1);
+  } else {
+    putchar('\007');
+  }
+}
+
+int find_line(struct editor *ed, int lineno, int *line, struct progress *progress) {
+ /**
+  * Finds the start of line number lineno, or of the last line if lineno is
+  * negative or past the end
+  * @return The position of the line, or -1 if interrupted
+  */
+  int l, pos, new_pos;
+  int total = strlen(ed->content);
 
   pos = 0;
   for (l = 0; l < lineno - 1 || lineno < 0; l++) {
+    if (l % SLICE_LINES == 0 && !keep_going(ed, progress, pos, total)) return -1;
     new_pos = next_line(ed, pos, 1);
     if (new_pos < 0) break;
     pos = new_pos;
   }
 
-  if (pos >= 0) {
-    moveto(ed, pos, 1);
-  } else {
+  *line = l;
+  return pos;
+}
+
+void show_line(struct editor *ed, int pos, int line) {
+ /**
+  * Puts the cursor at the start of the line at pos, centering it on the
+  * screen if it is not already visible
+  */
+  int i;
+
+  if (line < ed->topline || line >= ed->topline + ed->lines) {
+    ed->toppos = pos;
+    ed->topline = line;
+    for (i = 0; i < ed->lines / 2 && ed->toppos > 0; i++) {
+      ed->toppos = next_line(ed, ed->toppos, -1);
+      ed->topline--;
+    }
+  }
+
+  ed->linepos = pos;
+  ed->line = line;
+  ed->col = ed->lastcol = 0;
+  adjust(ed);
+}
+
+void goto_line(struct editor *ed, int lineno) {
+  struct progress progress;
+  int line, pos;
+
+  ed->anchor = -1;
+  if (!lineno && prompt(ed, "Goto line: ", 1, NULL)) {
+    lineno = atoi(ed->linebuf);
+  }
+
+  begin_progress(&progress, "Going to line");
+  pos = find_line(ed, lineno, &line, &progress);
+  if (pos >= 0) show_line(ed, pos, line);
+}
+
+void select_all(struct editor *ed) {
+  struct progress progress;
+  int line, pos;
+
+  begin_progress(&progress, "Selecting");
+  pos = find_line(ed, -1, &line, &progress);
+  if (pos < 0) return;
+
+  show_line(ed, pos, line);
+  ed->anchor = 0;
+  ed->col = ed->lastcol = line_length(ed, pos);
+  adjust(ed);
+}
+
+void goto_symbol(struct editor *ed, char *name) {
+  struct symbol *symbol = find_symbol(&ed->symbols, ed->content, name);
+
+  // Until the symbols are parsed the name is looked for as text
+  if (!symbol) {
+    find_text(ed, name, 0);
+    return;
+  }
+  ed->anchor = symbol->pos;
+  moveto(ed, symbol->pos + symbol->len, 1);
+}
+
+void goto_changed(struct editor *ed, char *query) {
+  // Text without one of the prefixes is looked for in every line
+  if (query[0] && !strchr(":#/@", query[0])) {
+    update_finder(ed, query);
+  } else if (ed->finder.shown) {
+    close_finder(ed);
+    draw_screen(ed);
+  }
+}
+
+void goto_result(struct editor *ed, char *query) {
+ /**
+  * Goes to the line picked from the finder's list, or to the best line if
+  * the query was entered before the list came up
+  */
+  struct finder *finder = &ed->finder;
+  int length, pos;
+
+  if (finder->pending || strcmp(finder->query, query)) {
+    length = strlen(ed->content);
+    finder->selected = 0;
+    finder->best.count = 0;
+    score_lines(&finder->best, ed->content, length, length, 0, query);
+    sort_best(&finder->best);
+  }
+  if (!finder->best.count) {
     putchar('\007');
+    return;
   }
+
+  pos = finder->best.hits[finder->selected].pos;
+  ed->anchor = -1;
+  show_line(ed, pos, line_number(ed, pos));
 }
 
 void goto_anything(struct editor *ed, char *query) {
+  int entered = 1;
+
   if (!query) {
-    prompt(ed, "Goto Anything: ", 1);
+    entered = prompt(ed, "Goto Anything: ", 1, goto_changed);
     query = ed->linebuf;
   }
 
   if (query[0] == ':') { goto_line(ed, atoi(query + 1)); }
-  if (query[0] == '#') { find_text(ed, query + 1); }
-  if (query[0] == '@') { find_text(ed, query + 1); }
-}
-
-void redraw_screen(struct editor *ed) {
-  get_console_size(ed);
-  draw_screen(ed);
+  if (query[0] == '#') { find_text(ed, query + 1, 0); }
+  if (query[0] == '/') { find_regex(ed, query + 1); }
+  if (query[0] == '@') { goto_symbol(ed, query + 1); }
+  if (entered && query[0] && !strchr(":#/@", query[0])) goto_result(ed, query);
+  close_finder(ed);
 }
 
 //
@@ -946,44 +2411,61 @@ void redraw_screen(struct editor *ed) {
 
 void edit(struct editor *ed) {
   int done = 0;
+  int redraw = 1;
   int key;
 
-  while (!done) {
-    draw_screen(ed);
-    draw_full_statusline(ed);
-    position_cursor(ed);
-    fflush(stdout);
+  if (ed->recover) recover_autosave(ed);
+
+  while (!done && !ed->quit) {
+    // Only render once all typeahead has been consumed
+    if (redraw && !key_pending()) {
+      update_index(ed);
+      update_symbols(ed);
+      update_match_count(ed);
+      schedule_autosave(ed);
+      draw_screen(ed);
+      draw_full_statusline(ed);
+      position_cursor(ed);
+      term_flush();
+      redraw = 0;
+    }
     key = get_key();
 
-    if (key >= ' ' && key <= 0x7F) {
-      insert_char(ed, (char) key);
+    if (key == KEY_EVENT || key == KEY_SIGNAL || key == KEY_TIMER) {
+      if (handle_event(ed, key)) redraw = 1;
+      continue;
+    }
+    redraw = 1;
+
+    if (printable(key)) {
+      insert_typed(ed, key);
     } else {
       switch (key) {
         case ctrl('t'): goto_line(ed, 1); break;
         case ctrl('b'): goto_line(ed, -1); break;
 
-        case KEY_UP: down(ed, 0, -1); break;
-        case KEY_DOWN: down(ed, 0, 1); break;
+        case KEY_UP: down_rows(ed, 0, -get_repeat(key)); break;
+        case KEY_DOWN: down_rows(ed, 0, get_repeat(key)); break;
         case KEY_LEFT: left(ed, 0); break;
         case KEY_RIGHT: right(ed, 0); break;
         case KEY_HOME: home(ed, 0); break;
         case KEY_END: end(ed, 0); break;
-        case KEY_PGUP: down(ed, 0, -PAGESIZE); break;
-        case KEY_PGDN: down(ed, 0, PAGESIZE); break;
-        case ctrl(KEY_UP): down(ed, 0, -PAGESIZE); break;
-        case ctrl(KEY_DOWN): down(ed, 0, PAGESIZE); break;
+        case KEY_PGUP: down_rows(ed, 0, -PAGESIZE * get_repeat(key)); break;
+        case KEY_PGDN: down_rows(ed, 0, PAGESIZE * get_repeat(key)); break;
+        case ctrl(KEY_UP): down_rows(ed, 0, -PAGESIZE * get_repeat(key)); break;
+        case ctrl(KEY_DOWN): down_rows(ed, 0, PAGESIZE * get_repeat(key)); break;
 
         case ctrl(KEY_RIGHT): wordright(ed, 0); break;
         case ctrl(KEY_LEFT): wordleft(ed, 0); break;
         case ctrl(KEY_HOME): goto_line(ed, 1); break;
         case ctrl(KEY_END): goto_line(ed, -1); break;
 
-        case shift(KEY_UP): down(ed, 1, -1); break;
-        case shift(KEY_DOWN): down(ed, 1, 1); break;
+        case shift(KEY_UP): down_rows(ed, 1, -get_repeat(key)); break;
+        case shift(KEY_DOWN): down_rows(ed, 1, get_repeat(key)); break;
         case shift(KEY_LEFT): left(ed, 1); break;
         case shift(KEY_RIGHT): right(ed, 1); break;
-        case shift(KEY_PGUP): down(ed, 1, -PAGESIZE); break;
-        case shift(KEY_PGDN): down(ed, 1, PAGESIZE); break;
+        case shift(KEY_PGUP): down_rows(ed, 1, -PAGESIZE * get_repeat(key)); break;
+        case shift(KEY_PGDN): down_rows(ed, 1, PAGESIZE * get_repeat(key)); break;
         case shift(KEY_HOME): home(ed, 1); break;
         case shift(KEY_END): end(ed, 1); break;
 
@@ -995,8 +2477,10 @@ void edit(struct editor *ed) {
         case ctrl('a'): select_all(ed); break;
         case ctrl('d'): duplicate_selection_or_line(ed); break;
         case ctrl('c'): copy_selection_or_line(ed); break;
-        case KEY_F3: find_text(ed, 0); break;
-        case ctrl('f'): find_text(ed, 0); break;
+        case KEY_F3: find_text(ed, 0, 0); break;
+        case shift(KEY_F3): find_text(ed, 0, 1); break;
+        case ctrl('f'): find_text(ed, 0, 0); break;
+        case ctrl('r'): find_text(ed, 0, 1); break;
         case ctrl('l'): goto_line(ed, 0); break;
         case ctrl('g'): goto_anything(ed, 0); break;
         case ctrl('q'): done = 1; break;
@@ -1006,20 +2490,23 @@ void edit(struct editor *ed) {
         case KEY_TAB: indent(ed, INDENT); break;
         case shift(KEY_TAB): unindent(ed, INDENT); break;
 
+        case KEY_ESC: highlight(ed, NULL); break;
         case KEY_ENTER: newline(ed); break;
         case KEY_BACKSPACE: backspace(ed); break;
         case KEY_DEL: del(ed); break;
         case ctrl('k'): erase_selection_or_line(ed); break;
         case ctrl('x'): cut_selection_or_line(ed); break;
         case ctrl('v'): paste_selection(ed); break;
+        case KEY_PASTE: paste_text(ed); break;
         case ctrl('s'): save_editor(ed); break;
-        default:
-          insert_char(ed, ((char*)&key)[0]);
-          insert_char(ed, ((char*)&key)[1]);
-          break;
+        default: break;
       }
     }
   }
+
+  // Quitting discards unsaved changes, so their autosave goes with them.
+  // It is kept when a signal ends the session.
+  if (!ed->quit) remove_autosave(ed);
 }
 
 //
@@ -1027,7 +2514,7 @@ void edit(struct editor *ed) {
 //
 
 int main(int argc, char *argv[]) {
-  sigset_t blocked_sigmask, orig_sigmask;
+  sigset_t blocked_sigmask, orig_sigmask, event_sigmask;
   struct termios tio;
   struct termios orig_tio;
 
@@ -1040,26 +2527,49 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  if (argc >= 3) goto_anything(&ed, argv[2]);
+  ed.keywords = compile_keywords(getenv("EM9_KEYWORDS"));
 
   setvbuf(stdout, NULL, 0, 8192);
+  get_console_size(&ed);
+  // Many terminals calling themselves xterm do not repeat characters with
+  // REP, so it is only used when asked for
+  term_rep = getenv("EM9_REP") != NULL;
+  if (getenv("EM9_SLICE_MS")) slice_ms = atoi(getenv("EM9_SLICE_MS"));
+
+  if (argc >= 3) goto_anything(&ed, argv[2]);
 
   tcgetattr(0, &orig_tio);
   cfmakeraw(&tio);  
   tcsetattr(0, TCSANOW, &tio);
+  fputs(PASTE_ON, stdout);
   linux_console = getenv("TERM") && !strcmp(getenv("TERM"), "linux");
 
-  get_console_size(&ed);
   sigemptyset(&blocked_sigmask);
   sigaddset(&blocked_sigmask, SIGINT);
   sigaddset(&blocked_sigmask, SIGTSTP);
   sigaddset(&blocked_sigmask, SIGABRT);
+  sigaddset(&blocked_sigmask, SIGWINCH);
+  sigaddset(&blocked_sigmask, SIGTERM);
   sigprocmask(SIG_BLOCK, &blocked_sigmask, &orig_sigmask);
 
+  // Resizes and termination are read from a descriptor like any other event
+  sigemptyset(&event_sigmask);
+  sigaddset(&event_sigmask, SIGWINCH);
+  sigaddset(&event_sigmask, SIGTERM);
+  ed.signalfd = signalfd(-1, &event_sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+  ed.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  // The keyboard reader and worker threads inherit the blocked signals
+  open_keyboard();
+  watch_event(pool_start(), KEY_EVENT);
+  watch_event(ed.signalfd, KEY_SIGNAL);
+  watch_event(ed.timerfd, KEY_TIMER);
+
   edit(&ed);
 
   printf(GOTO_LINE_COL, ed.lines + 2, 1);
-  fputs(RESET_COLOR CLREOL CLRSCR, stdout);
+  fputs(RESET_COLOR CLREOL CLRSCR PASTE_OFF, stdout);
+  close_keyboard();
   tcsetattr(0, TCSANOW, &orig_tio);   
 
   setbuf(stdout, NULL);
@@ -34,6 +34,7 @@
 ** appropriate header files.
 */
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <memory.h>
@@ -123,6 +124,7 @@ struct Decl {
                      ** of this name is a source file triggers the declaration
                      ** to be added to the header for that file. */
   const char *zFile; /* File from which extracted.  */
+  const char *zSource; /* Where the name appears in the text parsed */
   char *zIf;         /* Surround the declaration with this #if */
   char *zFwd;        /* A forward declaration.  NULL if there is none. */
   char *zFwdCpp;     /* Use this forward declaration for C++. */
@@ -372,6 +374,19 @@ static int doc_flag = 0;
 */
 static int proto_static = 0;
 
+/*
+** If the following flag is set, then every #define and typedef is
+** recorded, not only those in an interface, so that the declarations
+** can serve as an index of symbols.
+*/
+static int symbol_flag = 0;
+
+/*
+** If the following flag is set, errors in the input are not reported.
+** The text given to ParseSymbols() is often half written.
+*/
+static int quiet_flag = 0;
+
 /*
 ** A list of all declarations.  The list is held together using the
 ** pNext field of the Decl structure.
@@ -417,6 +432,16 @@ static void *SafeMalloc(int nByte){
   }
   return p;
 }
+/*
+** Report an error in the input, unless quiet_flag is set.
+*/
+static void ErrorMsg(const char *zFormat, ...){
+  va_list ap;
+  if( quiet_flag ) return;
+  va_start(ap, zFormat);
+  vfprintf(stderr, zFormat, ap);
+  va_end(ap);
+}
 static void SafeFree(void *pOld){
   if( pOld ){
     free(pOld);
@@ -442,7 +467,7 @@ static char *StrDup(const char *zSrc, int nByte){
     nByte = strlen(zSrc);
   }
   zDest = SafeMalloc( nByte + 1 );
-  strncpy(zDest,zSrc,nByte);
+  memcpy(zDest,zSrc,nByte);
   zDest[nByte] = 0;
   return zDest;
 }
@@ -488,7 +513,7 @@ static void StringAppend(String *pStr, const char *zText, int nByte){
 ** value between 0 and 2**31 - 1
 */
 static int Hash(const char *z, int n){
-  int h = 0;
+  unsigned int h = 0;
   if( n<=0 ){
     n = strlen(z);
   }
@@ -599,6 +624,7 @@ static Decl *CreateDecl(
   pDecl->zName = (char*)&pDecl[1];
   sprintf(pDecl->zName,"%.*s",nName,zName);
   pDecl->zFile = zFilename;
+  pDecl->zSource = zName;
   pDecl->pInclude = includeList;
   pDecl->zIf = GetIfString();
   InstallDecl(pDecl);
@@ -663,6 +689,7 @@ static int IdentTableTest(
   return 0;
 }
 
+#ifndef MAKEHEADERS_LIBRARY
 /*
 ** Remove every identifier from the given table.   Reset the table to
 ** its initial state.
@@ -736,6 +763,7 @@ static int WriteFile(const char *zFilename, const char *zOutput){
   fclose(pOut);
   return 0;
 }
+#endif /* !MAKEHEADERS_LIBRARY */
 
 /*
 ** Major token types
@@ -841,7 +869,7 @@ static int GetToken(InStream *pIn, Token *pToken){
         c = z[i];
         if( c=='\n' ){
           if( !nlisc ){
-            fprintf(stderr,
+            ErrorMsg(
               "%s:%d: (warning) Newline in string or character literal.\n",
               zFilename, pIn->nLine);
             nlisc = 1;
@@ -858,7 +886,7 @@ static int GetToken(InStream *pIn, Token *pToken){
           i++;
           c = 0;
         }else if( c==0 ){
-          fprintf(stderr, "%s:%d: Unterminated string or character literal.\n",
+          ErrorMsg("%s:%d: Unterminated string or character literal.\n",
              zFilename, startLine);
           nErr++;
         }
@@ -895,7 +923,7 @@ static int GetToken(InStream *pIn, Token *pToken){
           i += 2;
         }else{
           isBlockComment = 0;
-          fprintf(stderr,"%s:%d: Unterminated comment\n",
+          ErrorMsg("%s:%d: Unterminated comment\n",
             zFilename, startLine);
           nErr++;
         }
@@ -1035,7 +1063,7 @@ static int GetNonspaceToken(InStream *pIn, Token *pToken){
 
       case TT_EOF:
         if( nIf ){
-          fprintf(stderr,"%s:%d: Unterminated \"#if\"\n",
+          ErrorMsg("%s:%d: Unterminated \"#if\"\n",
              zFilename, startLine);
           nErr++;
         }
@@ -1150,7 +1178,7 @@ static int GetBigToken(InStream *pIn, Token *pToken, IdentTable *pTable){
        pToken->nText,pToken->zText); */
     switch( pToken->eType ){
       case TT_EOF:
-        fprintf(stderr,"%s:%d: Unterminated \"{\"\n",
+        ErrorMsg("%s:%d: Unterminated \"{\"\n",
            zFilename, nLine);
         nErr++;
         pToken->eType = TT_Error;
@@ -1410,7 +1438,7 @@ static char *TokensToString(
           pFirst = pFirst->pNext;
           continue;
         }
-        /* Fall thru to the next case */
+        /* Fall thru */
       case TT_Number:
         if( needSpace ){
           StringAppend(&str," ",1);
@@ -1659,7 +1687,7 @@ static Token *FindDeclName(Token *pFirst, Token *pLast){
 
       if( !isInit ){
         int i;
-        for(i=0; i<sizeof(aWords)/sizeof(aWords[0]); i++){
+        for(i=0; i<(int)(sizeof(aWords)/sizeof(aWords[0])); i++){
           IdentTableInsert(&sReserved,aWords[i],0);
         }
         isInit = 1;
@@ -1706,7 +1734,7 @@ static int ProcessMethodDef(Token *pFirst, Token *pLast, int flags){
   }
   pClass = FindDeclName(pFirst,pLast);
   if( pClass==0 ){
-    fprintf(stderr,"%s:%d: Unable to find the class name for this method\n",
+    ErrorMsg("%s:%d: Unable to find the class name for this method\n",
        zFilename, pFirst->nLine);
     return 1;
   }
@@ -1771,18 +1799,18 @@ static int ProcessProcedureDef(Token *pFirst, Token *pLast, int flags){
     pLast = pLast->pPrev;
   }
   if( pLast==0 || pLast==pFirst || pFirst->pNext==pLast ){
-    fprintf(stderr,"%s:%d: Unrecognized syntax.\n",
+    ErrorMsg("%s:%d: Unrecognized syntax.\n",
       zFilename, pFirst->nLine);
     return 1;
   }
   if( flags & (PS_Interface|PS_Export|PS_Local) ){
-    fprintf(stderr,"%s:%d: Missing \"inline\" on function or procedure.\n",
+    ErrorMsg("%s:%d: Missing \"inline\" on function or procedure.\n",
       zFilename, pFirst->nLine);
     return 1;
   }
   pName = FindDeclName(pFirst,pLast);
   if( pName==0 ){
-    fprintf(stderr,"%s:%d: Malformed function or procedure definition.\n",
+    ErrorMsg("%s:%d: Malformed function or procedure definition.\n",
       zFilename, pFirst->nLine);
     return 1;
   }
@@ -1839,13 +1867,13 @@ static int ProcessInlineProc(Token *pFirst, int flags, int *pReset){
   }
   if( pEnd==0 ){
     *pReset = ';';
-    fprintf(stderr,"%s:%d: incomplete inline procedure definition\n",
+    ErrorMsg("%s:%d: incomplete inline procedure definition\n",
       zFilename, pFirst->nLine);
     return 1;
   }
   pName = FindDeclName(pFirst,pEnd);
   if( pName==0 ){
-    fprintf(stderr,"%s:%d: malformed inline procedure definition\n",
+    ErrorMsg("%s:%d: malformed inline procedure definition\n",
       zFilename, pFirst->nLine);
     return 1;
   }
@@ -1935,11 +1963,13 @@ static int ProcessDecl(Token *pFirst, Token *pEnd, int flags){
   }
   if( flags & PS_Typedef ){
     if( (flags & (PS_Export2|PS_Local2))!=0 ){
-      fprintf(stderr,"%s:%d: \"EXPORT\" or \"LOCAL\" ignored before typedef.\n",
+      ErrorMsg("%s:%d: \"EXPORT\" or \"LOCAL\" ignored before typedef.\n",
         zFilename, pFirst->nLine);
       nErr++;
     }
-    if( (flags & (PS_Interface|PS_Export|PS_Local|DP_Cplusplus))==0 ){
+    if( (flags & (PS_Interface|PS_Export|PS_Local|DP_Cplusplus))==0
+     && !symbol_flag
+    ){
       /* It is illegal to duplicate a typedef in C (but OK in C++).
       ** So don't record typedefs that aren't within a C++ file or
       ** within #if INTERFACE..#endif */
@@ -1981,7 +2011,7 @@ static int ProcessDecl(Token *pFirst, Token *pEnd, int flags){
   isVar =  (flags & (PS_Typedef|PS_Method))==0 && isVariableDef(pFirst,pEnd);
   if( isVar && (flags & (PS_Interface|PS_Export|PS_Local))!=0
   && (flags & PS_Extern)==0 ){
-    fprintf(stderr,"%s:%d: Can't define a variable in this context\n",
+    ErrorMsg("%s:%d: Can't define a variable in this context\n",
       zFilename, pFirst->nLine);
     nErr++;
   }
@@ -1991,7 +2021,7 @@ static int ProcessDecl(Token *pFirst, Token *pEnd, int flags){
       /* Ignore completely anonymous enums.  See documentation section 3.8.1. */
       return nErr;
     }else{
-      fprintf(stderr,"%s:%d: Can't find a name for the object declared here.\n",
+      ErrorMsg("%s:%d: Can't find a name for the object declared here.\n",
         zFilename, pFirst->nLine);
       return nErr+1;
     }
@@ -2121,7 +2151,7 @@ static int ParsePreprocessor(Token *pToken, int flags, int *pPresetFlags){
     */
     pIf = ifStack;
     if( pIf==0 ){
-      fprintf(stderr,"%s:%d: extra '#endif'.\n",zFilename,pToken->nLine);
+      ErrorMsg("%s:%d: extra '#endif'.\n",zFilename,pToken->nLine);
       return 1;
     }
     ifStack = pIf->pNext;
@@ -2131,7 +2161,9 @@ static int ParsePreprocessor(Token *pToken, int flags, int *pPresetFlags){
     ** Record a #define if we are in PS_Interface or PS_Export
     */
     Decl *pDecl;
-    if( !(flags & (PS_Local|PS_Interface|PS_Export)) ){ return 0; }
+    if( !(flags & (PS_Local|PS_Interface|PS_Export)) && !symbol_flag ){
+      return 0;
+    }
     zArg = &zCmd[6];
     while( *zArg && isspace(*zArg) && *zArg!='\n' ){
       zArg++;
@@ -2163,7 +2195,7 @@ static int ParsePreprocessor(Token *pToken, int flags, int *pPresetFlags){
     if( (zArg[0]=='"' && zArg[nArg-1]!='"')
       ||(zArg[0]=='<' && zArg[nArg-1]!='>')
     ){
-      fprintf(stderr,"%s:%d: malformed #include statement.\n",
+      ErrorMsg("%s:%d: malformed #include statement.\n",
         zFilename,pToken->nLine);
       return 1;
     }
@@ -2234,7 +2266,7 @@ static int ParsePreprocessor(Token *pToken, int flags, int *pPresetFlags){
     ** Invert the #if on the top of the stack
     */
     if( ifStack==0 ){
-      fprintf(stderr,"%s:%d: '#else' without an '#if'\n",zFilename,
+      ErrorMsg("%s:%d: '#else' without an '#if'\n",zFilename,
          pToken->nLine);
       return 1;
     }
@@ -2303,7 +2335,7 @@ static int ParseFile(Token *pList, int initFlags){
         break;
 
       case '=':
-        if( pList->pPrev->nText==8
+        if( pList->pPrev && pList->pPrev->nText==8
             && strncmp(pList->pPrev->zText,"operator",8)==0 ){
           break;
         }
@@ -2362,7 +2394,8 @@ static int ParseFile(Token *pList, int initFlags){
            }
          }else if( pList->nText==6 && strncmp(pList->zText,"extern",6)==0 ){
            pList = pList->pNext;
-           if( pList && pList->nText==3 && strncmp(pList->zText,"\"C\"",3)==0 ){
+           if( pList==0 ) goto end_of_loop;
+           if( pList->nText==3 && strncmp(pList->zText,"\"C\"",3)==0 ){
              pList = pList->pNext;
              flags &= ~DP_Cplusplus;
            }else{
@@ -2458,7 +2491,7 @@ static int ParseFile(Token *pList, int initFlags){
   while( ifStack ){
     Ifmacro *pIf = ifStack;
     ifStack = pIf->pNext;
-    fprintf(stderr,"%s:%d: This '#if' has no '#endif'\n",zFilename,
+    ErrorMsg("%s:%d: This '#if' has no '#endif'\n",zFilename,
       pIf->nLine);
     SafeFree(pIf);
   }
@@ -2466,6 +2499,12 @@ static int ParseFile(Token *pList, int initFlags){
   return nErr;
 }
 
+/*
+** Everything from here to ParseSymbols() generates header files, which the
+** library build does not do.
+*/
+#ifndef MAKEHEADERS_LIBRARY
+
 /*
 ** If the given Decl object has a non-null zExtra field, then the text
 ** of that zExtra field needs to be inserted in the middle of the
@@ -3289,7 +3328,68 @@ static const char zInit[] =
   "#define PROTECTED\n"
 ;
 
-#if TEST==0
+#else
+/*
+** Parse the C source text zText and hand every function, type, macro and
+** variable declared in it to xSymbol, along with:
+**
+**    iOffset       The offset of the name in zText
+**    iResume       For a function definition, the offset just past its
+**                  body, where parsing can pick up again.  Otherwise -1.
+**    isDefinition  False for a prototype, true for anything else
+**
+** This routine uses the global state of the parser and is not reentrant.
+** Return the number of errors seen, or -1 if zText could not be tokenized.
+*/
+int ParseSymbols(
+  const char *zText,
+  void (*xSymbol)(void*,const char*,int iOffset,int iResume,int isDefinition),
+  void *pArg
+){
+  Token *pList;
+  Decl *pDecl, *pNext;
+  Include *pInclude;
+  int nErr;
+  int isDefinition;
+
+  zFilename = "";
+  proto_static = 1;
+  symbol_flag = 1;
+  quiet_flag = 1;
+  pList = TokenizeFile(zText,0);
+  if( pList==0 ){
+    return -1;
+  }
+  nErr = ParseFile(pList,0);
+
+  for(pDecl=pDeclFirst; pDecl; pDecl=pNext){
+    pNext = pDecl->pNext;
+    isDefinition = !DeclHasProperty(pDecl,TY_Subroutine)
+                   || pDecl->tokenCode.zText!=0;
+    xSymbol(pArg, pDecl->zName, (int)(pDecl->zSource - zText),
+       pDecl->tokenCode.zText ?
+         (int)(pDecl->tokenCode.zText + pDecl->tokenCode.nText - zText) : -1,
+       isDefinition);
+    SafeFree(pDecl->zIf);
+    SafeFree(pDecl->zFwd);
+    SafeFree(pDecl->zFwdCpp);
+    SafeFree(pDecl->zDecl);
+    SafeFree(pDecl->zExtra);
+    SafeFree(pDecl);
+  }
+  pDeclFirst = pDeclLast = 0;
+  memset(apTable,0,sizeof(apTable));
+  while( includeList ){
+    pInclude = includeList;
+    includeList = pInclude->pNext;
+    SafeFree(pInclude);
+  }
+  FreeTokenList(pList);
+  return nErr;
+}
+#endif
+
+#if TEST==0 && !defined(MAKEHEADERS_LIBRARY)
 int main(int argc, char **argv){
   int i;                /* Loop counter */
   int nErr = 0;         /* Number of errors encountered */
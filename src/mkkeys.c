@@ -0,0 +1,174 @@
+/*
+ * Generates src/keys_table.h, the trie used by get_keys() to decode input.
+ *
+ * Every byte sequence a terminal may send for a key is listed below. They are
+ * merged into a trie whose nodes hold the key produced by the sequence ending
+ * there, and whose edges are stored sorted by byte.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NODES      512
+
+// Which Linux console modifier keys apply to a sequence
+#define MOD_SHIFT      1
+#define MOD_CTRL       2
+#define MOD_BOTH       3
+
+#define SEQ(s)         s, sizeof(s) - 1
+
+struct entry {
+  char *seq;
+  int len;
+  char *key;
+  int mods;
+};
+
+static struct entry entries[] = {
+  {SEQ("\x08"), "KEY_BACKSPACE", 0},
+  {SEQ("\x09"), "KEY_TAB", MOD_BOTH},
+  {SEQ("\x0A"), "KEY_ENTER", 0},
+  {SEQ("\x0D"), "KEY_ENTER", 0},
+  {SEQ("\x7F"), "KEY_BACKSPACE", 0},
+
+  {SEQ("\033\033"), "KEY_ESC", 0},
+
+  {SEQ("\033OF"), "KEY_END", 0},
+  {SEQ("\033OH"), "KEY_HOME", 0},
+  {SEQ("\033OR"), "KEY_F3", 0},
+
+  {SEQ("\033[1~"), "KEY_HOME", MOD_BOTH},
+  {SEQ("\033[2~"), "KEY_INS", 0},
+  {SEQ("\033[3~"), "KEY_DEL", 0},
+  {SEQ("\033[4~"), "KEY_END", MOD_BOTH},
+  {SEQ("\033[5~"), "KEY_PGUP", MOD_SHIFT},
+  {SEQ("\033[6~"), "KEY_PGDN", MOD_SHIFT},
+  {SEQ("\033[13~"), "KEY_F3", 0},
+  {SEQ("\033[13;2~"), "shift(KEY_F3)", 0},
+  {SEQ("\033[25~"), "shift(KEY_F3)", 0},
+  {SEQ("\033[1;2R"), "shift(KEY_F3)", 0},
+  {SEQ("\033[A"), "KEY_UP", MOD_BOTH},
+  {SEQ("\033[B"), "KEY_DOWN", MOD_BOTH},
+  {SEQ("\033[C"), "KEY_RIGHT", MOD_BOTH},
+  {SEQ("\033[D"), "KEY_LEFT", MOD_BOTH},
+  {SEQ("\033[F"), "KEY_END", MOD_BOTH},
+  {SEQ("\033[H"), "KEY_HOME", MOD_BOTH},
+  {SEQ("\033[Z"), "shift(KEY_TAB)", 0},
+  {SEQ("\033[[C"), "KEY_F3", 0},
+  {SEQ("\033[200~"), "KEY_PASTE", 0},
+
+  {SEQ("\0\x0F"), "shift(KEY_TAB)", 0},
+  {SEQ("\0\x3D"), "KEY_F3", 0},
+  {SEQ("\0\x47"), "KEY_HOME", 0},
+  {SEQ("\0\x48"), "KEY_UP", 0},
+  {SEQ("\0\x49"), "KEY_PGUP", 0},
+  {SEQ("\0\x4B"), "KEY_LEFT", 0},
+  {SEQ("\0\x4D"), "KEY_RIGHT", 0},
+  {SEQ("\0\x4F"), "KEY_END", 0},
+  {SEQ("\0\x50"), "KEY_DOWN", 0},
+  {SEQ("\0\x51"), "KEY_PGDN", 0},
+  {SEQ("\0\x52"), "KEY_INS", 0},
+  {SEQ("\0\x53"), "KEY_DEL", 0},
+  {SEQ("\0\x73"), "ctrl(KEY_LEFT)", 0},
+  {SEQ("\0\x74"), "ctrl(KEY_RIGHT)", 0},
+  {SEQ("\0\x75"), "ctrl(KEY_END)", 0},
+  {SEQ("\0\x77"), "ctrl(KEY_HOME)", 0},
+  {SEQ("\0\x8D"), "ctrl(KEY_UP)", 0},
+  {SEQ("\0\x91"), "ctrl(KEY_DOWN)", 0},
+  {SEQ("\0\x94"), "ctrl(KEY_TAB)", 0},
+  {SEQ("\0\xB8"), "shift(KEY_UP)", 0},
+  {SEQ("\0\xB7"), "shift(KEY_HOME)", 0},
+  {SEQ("\0\xBF"), "shift(KEY_END)", 0},
+  {SEQ("\0\xB9"), "shift(KEY_PGUP)", 0},
+  {SEQ("\0\xBB"), "shift(KEY_LEFT)", 0},
+  {SEQ("\0\xBD"), "shift(KEY_RIGHT)", 0},
+  {SEQ("\0\xC0"), "shift(KEY_DOWN)", 0},
+  {SEQ("\0\xC1"), "shift(KEY_PGDN)", 0},
+  {SEQ("\0\xDB"), "shift(ctrl(KEY_LEFT))", 0},
+  {SEQ("\0\xDD"), "shift(ctrl(KEY_RIGHT))", 0},
+  {SEQ("\0\xD8"), "shift(ctrl(KEY_UP))", 0},
+  {SEQ("\0\xE0"), "shift(ctrl(KEY_DOWN))", 0},
+  {SEQ("\0\xD7"), "shift(ctrl(KEY_HOME))", 0},
+  {SEQ("\0\xDF"), "shift(ctrl(KEY_END))", 0},
+};
+
+// xterm style modifier parameters, e.g. ESC [ 1 ; 5 A for Ctrl+Up
+static char *modified_finals = "ABCDFH";
+static char *modified_keys[] = {"KEY_UP", "KEY_DOWN", "KEY_RIGHT", "KEY_LEFT", "KEY_END", "KEY_HOME"};
+static char modifier_params[] = {'2', '5', '6'};
+static char *modifier_formats[] = {"shift(%s)", "ctrl(%s)", "shift(ctrl(%s))"};
+
+struct node {
+  char *key;
+  int mods;
+  int children[256];
+};
+
+static struct node nodes[MAX_NODES];
+static int num_nodes = 1;
+
+void add(const char *seq, int len, char *key, int mods) {
+  int n = 0;
+  int i, ch;
+
+  for (i = 0; i < len; i++) {
+    ch = (unsigned char) seq[i];
+    if (!nodes[n].children[ch]) {
+      if (num_nodes == MAX_NODES) {
+        fprintf(stderr, "mkkeys: too many nodes\n");
+        exit(1);
+      }
+      nodes[n].children[ch] = num_nodes++;
+    }
+    n = nodes[n].children[ch];
+  }
+
+  if (nodes[n].key) {
+    fprintf(stderr, "mkkeys: duplicate sequence for %s\n", key);
+    exit(1);
+  }
+  nodes[n].key = key;
+  nodes[n].mods = mods;
+}
+
+int main() {
+  char seq[8], *key;
+  int i, j, ch, edges;
+
+  for (i = 0; i < (int) (sizeof(entries) / sizeof(entries[0])); i++) {
+    add(entries[i].seq, entries[i].len, entries[i].key, entries[i].mods);
+  }
+
+  for (i = 0; modified_finals[i]; i++) {
+    for (j = 0; j < (int) sizeof(modifier_params); j++) {
+      sprintf(seq, "\033[1;%c%c", modifier_params[j], modified_finals[i]);
+      key = malloc(64);
+      sprintf(key, modifier_formats[j], modified_keys[i]);
+      add(seq, strlen(seq), key, 0);
+    }
+  }
+
+  printf("/* This file was automatically generated by mkkeys.  Do not edit! */\n\n");
+
+  printf("static const struct key_node key_nodes[%d] = {\n", num_nodes);
+  edges = 0;
+  for (i = 0; i < num_nodes; i++) {
+    int count = 0;
+    for (ch = 0; ch < 256; ch++) count += nodes[i].children[ch] != 0;
+    printf("  {%d, %d, %s, %d},\n", edges, count, nodes[i].key ? nodes[i].key : "0", nodes[i].mods);
+    edges += count;
+  }
+  printf("};\n\n");
+
+  printf("static const struct key_edge key_edges[%d] = {\n", edges);
+  for (i = 0; i < num_nodes; i++) {
+    for (ch = 0; ch < 256; ch++) {
+      if (nodes[i].children[ch]) printf("  {0x%02X, %d},\n", ch, nodes[i].children[ch]);
+    }
+  }
+  printf("};\n");
+
+  return 0;
+}
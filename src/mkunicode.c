@@ -0,0 +1,167 @@
+/*
+ * Generates src/unicode_tables.h from the C library's Unicode data.
+ *
+ * Run at build time so that em9 itself does not depend on the locale of the
+ * machine it runs on. Widths are stored as a two-level table: an index of
+ * 256-codepoint blocks pointing into a deduplicated set of blocks, each packed
+ * at two bits per codepoint.
+ *
+ * Case folding uses the same layout with a signed offset from each codepoint
+ * to its lowercase form. Only foldings that keep the length of the UTF-8
+ * encoding are included, so that a case-insensitive match is always as long
+ * as the text searched for.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#define MAX_CODEPOINT  0x110000
+#define BLOCK_SIZE     256
+#define BLOCK_BYTES    (BLOCK_SIZE / 4)
+#define NUM_BLOCKS     (MAX_CODEPOINT / BLOCK_SIZE)
+
+static unsigned char blocks[NUM_BLOCKS][BLOCK_BYTES];
+static int index_table[NUM_BLOCKS];
+static int num_unique;
+
+static int fold_blocks[NUM_BLOCKS][BLOCK_SIZE];
+static int fold_index[NUM_BLOCKS];
+static int num_folds;
+
+static char *locales[] = {"C.UTF-8", "C.utf8", "en_US.UTF-8", "en_US.utf8", 0};
+
+int width_of(int cp) {
+  int w;
+
+  // Control characters are passed through to the terminal as single bytes
+  if (cp < 0x20 || cp == 0x7F) return 1;
+
+  // Surrogates never appear in valid UTF-8
+  if (cp >= 0xD800 && cp <= 0xDFFF) return 1;
+
+  w = wcwidth(cp);
+  if (w < 0) return 1;
+  if (w > 2) return 2;
+  return w;
+}
+
+void build_widths() {
+  unsigned char block[BLOCK_BYTES];
+  int b, i, j;
+
+  for (b = 0; b < NUM_BLOCKS; b++) {
+    memset(block, 0, sizeof(block));
+    for (i = 0; i < BLOCK_SIZE; i++) {
+      block[i / 4] |= width_of(b * BLOCK_SIZE + i) << (2 * (i % 4));
+    }
+
+    for (j = 0; j < num_unique; j++) {
+      if (!memcmp(blocks[j], block, BLOCK_BYTES)) break;
+    }
+    if (j == num_unique) memcpy(blocks[num_unique++], block, BLOCK_BYTES);
+    index_table[b] = j;
+  }
+}
+
+int encoded_length(int cp) {
+  if (cp < 0x80) return 1;
+  if (cp < 0x800) return 2;
+  if (cp < 0x10000) return 3;
+  return 4;
+}
+
+void build_folds() {
+  int block[BLOCK_SIZE];
+  int b, i, j, cp, lower;
+
+  for (b = 0; b < NUM_BLOCKS; b++) {
+    for (i = 0; i < BLOCK_SIZE; i++) {
+      cp = b * BLOCK_SIZE + i;
+      lower = cp >= 0xD800 && cp <= 0xDFFF ? cp : (int) towlower(cp);
+      block[i] = encoded_length(lower) == encoded_length(cp) ? lower - cp : 0;
+    }
+
+    for (j = 0; j < num_folds; j++) {
+      if (!memcmp(fold_blocks[j], block, sizeof(block))) break;
+    }
+    if (j == num_folds) memcpy(fold_blocks[num_folds++], block, sizeof(block));
+    fold_index[b] = j;
+  }
+}
+
+void print_folds() {
+  int i, j;
+
+  printf("static const unsigned char fold_index[%d] = {", NUM_BLOCKS);
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    printf("%s%d,", i % 24 ? "" : "\n  ", fold_index[i]);
+  }
+  printf("\n};\n\n");
+
+  printf("static const int fold_blocks[%d][%d] = {\n", num_folds, BLOCK_SIZE);
+  for (i = 0; i < num_folds; i++) {
+    printf("  {");
+    for (j = 0; j < BLOCK_SIZE; j++) {
+      printf("%s%d,", j % 16 || !j ? "" : "\n   ", fold_blocks[i][j]);
+    }
+    printf("},\n");
+  }
+  printf("};\n");
+}
+
+void print_widths() {
+  int i, j;
+
+  printf("static const unsigned char width_index[%d] = {", NUM_BLOCKS);
+  for (i = 0; i < NUM_BLOCKS; i++) {
+    printf("%s%d,", i % 24 ? "" : "\n  ", index_table[i]);
+  }
+  printf("\n};\n\n");
+
+  printf("static const unsigned char width_blocks[%d][%d] = {\n", num_unique, BLOCK_BYTES);
+  for (i = 0; i < num_unique; i++) {
+    printf("  {");
+    for (j = 0; j < BLOCK_BYTES; j++) {
+      printf("%s0x%02x,", j % 16 || !j ? "" : "\n   ", blocks[i][j]);
+    }
+    printf("},\n");
+  }
+  printf("};\n");
+}
+
+int main() {
+  char **locale;
+
+  for (locale = locales; *locale; locale++) {
+    if (setlocale(LC_CTYPE, *locale)) break;
+  }
+
+  if (!*locale) {
+    fprintf(stderr, "mkunicode: no UTF-8 locale available\n");
+    return 1;
+  }
+
+  build_widths();
+  if (num_unique > 256) {
+    fprintf(stderr, "mkunicode: too many unique width blocks\n");
+    return 1;
+  }
+
+  build_folds();
+  if (num_folds > 256) {
+    fprintf(stderr, "mkunicode: too many unique case folding blocks\n");
+    return 1;
+  }
+
+  printf("/* This file was automatically generated by mkunicode.  Do not edit! */\n\n");
+  print_widths();
+  printf("\n");
+  print_folds();
+  return 0;
+}
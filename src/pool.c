@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "pool.h"
+#include "snapshot.h"
+
+#if INTERFACE
+
+struct job {
+  void (*run)(struct job *job);    // Called on a worker thread
+  void (*done)(struct job *job);   // Called on the main thread if still current
+  void *owner;
+  unsigned generation;             // Buffer generation the job was submitted for
+  struct snapshot *snap;           // Text the job works on
+  void *data;                      // Freed along with the job
+  long result[4];
+  struct job *next;
+};
+
+#endif
+
+#define MAX_WORKERS    8
+#define DEQUE_SIZE     64
+
+// Each worker pops its own jobs from the bottom of its deque and steals from
+// the top of the others when it runs dry
+struct deque {
+  pthread_mutex_t lock;
+  struct job *jobs[DEQUE_SIZE];
+  int top, bottom;
+};
+
+static struct deque deques[MAX_WORKERS];
+static pthread_t workers[MAX_WORKERS];
+static int num_workers;
+static int next_deque;
+
+static atomic_uint generation;
+
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_wakeup = PTHREAD_COND_INITIALIZER;
+static int queued;
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct job *finished;
+static int donefd[2] = {-1, -1};
+
+int job_cancelled(struct job *job) {
+  // A broken snapshot may have been read while its text was changing
+  return job->generation != atomic_load_explicit(&generation, memory_order_relaxed) || atomic_load(&job->snap->broken);
+}
+
+void pool_advance(unsigned current) {
+ /**
+  * Makes current the buffer generation results are wanted for. Jobs
+  * submitted for older generations are cancelled.
+  */
+  atomic_store_explicit(&generation, current, memory_order_relaxed);
+}
+
+static int push(struct deque *d, struct job *job) {
+  int ok;
+
+  pthread_mutex_lock(&d->lock);
+  ok = d->bottom - d->top < DEQUE_SIZE;
+  if (ok) d->jobs[d->bottom++ % DEQUE_SIZE] = job;
+  pthread_mutex_unlock(&d->lock);
+  return ok;
+}
+
+static struct job *pop(struct deque *d, int steal) {
+  struct job *job = NULL;
+
+  pthread_mutex_lock(&d->lock);
+  if (d->bottom > d->top) job = steal ? d->jobs[d->top++ % DEQUE_SIZE] : d->jobs[--d->bottom % DEQUE_SIZE];
+  pthread_mutex_unlock(&d->lock);
+  return job;
+}
+
+static struct job *take(int self) {
+  struct job *job;
+  int i;
+
+  job = pop(&deques[self], 0);
+  for (i = 1; !job && i < num_workers; i++) job = pop(&deques[(self + i) % num_workers], 1);
+
+  if (job) {
+    pthread_mutex_lock(&idle_lock);
+    queued--;
+    pthread_mutex_unlock(&idle_lock);
+  }
+  return job;
+}
+
+static void finish(struct job *job) {
+  pthread_mutex_lock(&done_lock);
+  job->next = finished;
+  finished = job;
+  pthread_mutex_unlock(&done_lock);
+
+  if (write(donefd[1], "", 1) < 0) {
+    // The pipe is full, so the main thread has a wakeup pending anyway
+  }
+}
+
+static void *work(void *arg) {
+  int self = (struct deque *) arg - deques;
+  struct job *job;
+
+  for (;;) {
+    job = take(self);
+    if (!job) {
+      pthread_mutex_lock(&idle_lock);
+      while (!queued) pthread_cond_wait(&idle_wakeup, &idle_lock);
+      pthread_mutex_unlock(&idle_lock);
+      continue;
+    }
+
+    if (!job_cancelled(job)) job->run(job);
+    finish(job);
+  }
+
+  return NULL;
+}
+
+int pool_start() {
+ /**
+  * Starts one worker per processor
+  * @return A descriptor that becomes readable when jobs have finished
+  */
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+
+  if (pipe2(donefd, O_NONBLOCK | O_CLOEXEC) < 0) return -1;
+
+  num_workers = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : cpus;
+  for (i = 0; i < num_workers; i++) {
+    pthread_mutex_init(&deques[i].lock, NULL);
+    if (pthread_create(&workers[i], NULL, work, &deques[i])) break;
+  }
+  num_workers = i;
+
+  return num_workers ? donefd[0] : -1;
+}
+
+int pool_submit(void (*run)(struct job *job), void (*done)(struct job *job), void *owner, struct snapshot *snap, void *data) {
+ /**
+  * Queues run to be called on snap, which the job holds a reference to. The
+  * job owns data, if any, from now on.
+  * @return Zero on success, -1 if the job could not be queued
+  */
+  struct job *job;
+  int i;
+
+  if (!num_workers || !snap || !(job = calloc(1, sizeof(struct job)))) {
+    free(data);
+    return -1;
+  }
+
+  retain_snapshot(snap);
+  job->snap = snap;
+  job->run = run;
+  job->done = done;
+  job->owner = owner;
+  job->generation = snap->generation;
+  job->data = data;
+
+  // Counted before it can be taken, so the count never drops below zero
+  pthread_mutex_lock(&idle_lock);
+  queued++;
+  for (i = 0; i < num_workers; i++) {
+    next_deque = (next_deque + 1) % num_workers;
+    if (push(&deques[next_deque], job)) break;
+  }
+  if (i == num_workers) {
+    queued--;
+  } else {
+    pthread_cond_signal(&idle_wakeup);
+  }
+  pthread_mutex_unlock(&idle_lock);
+
+  if (i == num_workers) {
+    release_snapshot(job->snap);
+    free(job->data);
+    free(job);
+    return -1;
+  }
+  return 0;
+}
+
+int pool_collect() {
+ /**
+  * Hands finished jobs that are still current to their done callbacks
+  * @return The number of results delivered
+  */
+  struct job *job, *next;
+  char buf[64];
+  int n = 0;
+
+  while (read(donefd[0], buf, sizeof(buf)) > 0);
+
+  pthread_mutex_lock(&done_lock);
+  job = finished;
+  finished = NULL;
+  pthread_mutex_unlock(&done_lock);
+
+  for (; job; job = next) {
+    next = job->next;
+    if (!job_cancelled(job)) {
+      job->done(job);
+      n++;
+    }
+    release_snapshot(job->snap);
+    free(job->data);
+    free(job);
+  }
+
+  return n;
+}
@@ -0,0 +1,19 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+int pool_collect();
+typedef struct job job;
+struct job {
+  void (*run)(struct job *job);    // Called on a worker thread
+  void (*done)(struct job *job);   // Called on the main thread if still current
+  void *owner;
+  unsigned generation;             // Buffer generation the job was submitted for
+  struct snapshot *snap;           // Text the job works on
+  void *data;                      // Freed along with the job
+  long result[4];
+  struct job *next;
+};
+int pool_submit(void(*run)(struct job *job),void(*done)(struct job *job),void *owner,struct snapshot *snap,void *data);
+int pool_start();
+void pool_advance(unsigned current);
+int job_cancelled(struct job *job);
+#define INTERFACE 0
@@ -0,0 +1,662 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "regex.h"
+#include "search.h"
+
+#if INTERFACE
+
+struct regex {
+  struct rprog *forward;     // Finds where the leftmost match ends
+  struct rprog *reverse;     // Finds where the match ending there starts
+  char prefix[MAX_PREFIX];   // Text every match starts with
+  int prefix_len;
+};
+
+#define MAX_PREFIX     64
+
+#endif
+
+#define DFA_STATES     512             // States cached per program before the cache is flushed
+#define DFA_HASH       1024
+#define END_OF_TEXT    256
+
+// Parsed pattern
+enum {N_SET, N_CAT, N_ALT, N_STAR, N_PLUS, N_QUEST, N_BOL, N_EOL, N_EMPTY};
+
+struct rnode {
+  int type;
+  int a, b;                  // Operands
+  int greedy;                // Repetition prefers more
+  unsigned char set[32];     // Bytes matched by N_SET
+};
+
+struct parser {
+  const char *p;
+  struct rnode *nodes;
+  int num_nodes;
+  int max_nodes;
+  int error;
+};
+
+// Compiled program
+enum {R_BYTE, R_SPLIT, R_BOL, R_EOL, R_MATCH};
+
+struct rinst {
+  int op;
+  int out, out1;             // Next instruction, and the alternative for R_SPLIT
+  unsigned char set[32];     // Bytes accepted by R_BYTE
+};
+
+// A DFA state is the list of instructions waiting for the next byte, in
+// priority order, and whether the last byte ended a line
+struct dstate {
+  int bol;
+  int matched[2];            // Match before the next byte, unless and if it ends a line
+  int num_kernel;
+  int *kernel;
+  unsigned hash;
+  struct dstate *chain;      // Next state in the same hash bucket
+  struct dstate *next[256];  // Transitions computed so far
+};
+
+struct rprog {
+  struct rinst *insts;
+  int num_insts;
+  int start;
+  int longest;               // Keep going after a match instead of preferring it
+  int *mark;
+  int markgen;
+  int *list;                 // Scratch lists of instructions
+  int *kernel;
+  int num_states;
+  int flushes;               // Times the cache was emptied
+  struct dstate *table[DFA_HASH];
+  struct dstate *starts[2];
+};
+
+#define HAS(set, c)    ((set)[(c) >> 3] & (1 << ((c) & 7)))
+#define ADD(set, c)    ((set)[(c) >> 3] |= 1 << ((c) & 7))
+
+//
+// Parser
+//
+
+static int node(struct parser *ps, int type, int a, int b) {
+  struct rnode *nodes;
+
+  if (ps->num_nodes == ps->max_nodes) {
+    ps->max_nodes = ps->max_nodes ? ps->max_nodes * 2 : 64;
+    nodes = realloc(ps->nodes, ps->max_nodes * sizeof(struct rnode));
+    if (!nodes) {
+      ps->error = 1;
+      ps->max_nodes = ps->num_nodes;
+      return -1;
+    }
+    ps->nodes = nodes;
+  }
+
+  memset(&ps->nodes[ps->num_nodes], 0, sizeof(struct rnode));
+  ps->nodes[ps->num_nodes].type = type;
+  ps->nodes[ps->num_nodes].a = a;
+  ps->nodes[ps->num_nodes].b = b;
+  ps->nodes[ps->num_nodes].greedy = 1;
+  return ps->num_nodes++;
+}
+
+static int cat(struct parser *ps, int a, int b) {
+  if (a < 0) return b;
+  if (b < 0) return a;
+  return node(ps, N_CAT, a, b);
+}
+
+static int byte_range(struct parser *ps, int lo, int hi) {
+  int n = node(ps, N_SET, -1, -1);
+  int c;
+
+  if (n >= 0) {
+    for (c = lo; c <= hi; c++) ADD(ps->nodes[n].set, c);
+  }
+  return n;
+}
+
+static int multibyte(struct parser *ps) {
+  // Any character of two to four bytes
+  int cont = 0x80, lead[] = {0xC0, 0xE0, 0xF0, 0xF8};
+  int i, j, seq, any = -1;
+
+  for (i = 0; i < 3; i++) {
+    seq = byte_range(ps, lead[i], lead[i + 1] - 1);
+    for (j = 0; j <= i; j++) seq = cat(ps, seq, byte_range(ps, cont, 0xBF));
+    any = any < 0 ? seq : node(ps, N_ALT, any, seq);
+  }
+  return any;
+}
+
+static int utf8_length(int c) {
+  if (c < 0xC0) return 1;
+  if (c < 0xE0) return 2;
+  if (c < 0xF0) return 3;
+  return 4;
+}
+
+static int char_class(int c, unsigned char *set) {
+ /**
+  * Adds the bytes of the class escape \c to set
+  * @return Zero if c is not a class escape
+  */
+  int i;
+
+  for (i = 0; i < 128; i++) {
+    if ((c == 'd' && i >= '0' && i <= '9') ||
+        (c == 's' && (i == ' ' || (i >= '\t' && i <= '\r'))) ||
+        (c == 'w' && (i == '_' || (i >= '0' && i <= '9') || ((i | 0x20) >= 'a' && (i | 0x20) <= 'z')))) {
+      ADD(set, i);
+    }
+  }
+  return c == 'd' || c == 's' || c == 'w';
+}
+
+static int escaped(int c) {
+  if (c == 'n') return '\n';
+  if (c == 't') return '\t';
+  if (c == 'r') return '\r';
+  return c;
+}
+
+static int parse_alt(struct parser *ps);
+
+static int parse_class(struct parser *ps) {
+ /**
+  * Parses a bracket expression. Multibyte characters can be listed but not
+  * used in ranges, and negated classes match any multibyte character.
+  */
+  unsigned char set[32];
+  int negate, first, lo, hi, len, i, n, c;
+  int other = -1;
+
+  memset(set, 0, sizeof(set));
+  negate = *ps->p == '^';
+  if (negate) ps->p++;
+
+  for (first = 1; *ps->p && (first || *ps->p != ']'); first = 0) {
+    lo = (unsigned char) *ps->p++;
+    if (lo == '\\' && *ps->p) {
+      lo = (unsigned char) *ps->p++;
+      if (char_class(lo, set)) continue;
+      lo = escaped(lo);
+    } else if (lo >= 0x80) {
+      // A listed multibyte character is one more alternative
+      len = utf8_length(lo);
+      if (negate || ps->p[0] == '-') goto err;
+      n = byte_range(ps, lo, lo);
+      for (i = 1; i < len && *ps->p; i++) {
+        c = (unsigned char) *ps->p++;
+        n = cat(ps, n, byte_range(ps, c, c));
+      }
+      other = other < 0 ? n : node(ps, N_ALT, other, n);
+      continue;
+    }
+
+    hi = lo;
+    if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']') {
+      hi = (unsigned char) ps->p[1];
+      ps->p += 2;
+      if (hi == '\\' && *ps->p) hi = escaped((unsigned char) *ps->p++);
+      if (hi >= 0x80 || hi < lo) goto err;
+    }
+    for (c = lo; c <= hi; c++) ADD(set, c);
+  }
+  if (*ps->p != ']') goto err;
+  ps->p++;
+
+  n = node(ps, N_SET, -1, -1);
+  if (n < 0) return -1;
+  if (negate) {
+    for (c = 0; c < 128; c++) {
+      if (!HAS(set, c)) ADD(ps->nodes[n].set, c);
+    }
+    return node(ps, N_ALT, n, multibyte(ps));
+  }
+  memcpy(ps->nodes[n].set, set, sizeof(set));
+  return other < 0 ? n : node(ps, N_ALT, n, other);
+
+err:
+  ps->error = 1;
+  return -1;
+}
+
+static int parse_atom(struct parser *ps) {
+  int c = (unsigned char) *ps->p++;
+  int n, i, len;
+
+  switch (c) {
+    case '(':
+      if (ps->p[0] == '?' && ps->p[1] == ':') ps->p += 2;
+      n = parse_alt(ps);
+      if (*ps->p == ')') {
+        ps->p++;
+      } else {
+        ps->error = 1;
+      }
+      return n;
+
+    case '[':
+      return parse_class(ps);
+
+    case '.':
+      n = byte_range(ps, 0, 0x7F);
+      if (n >= 0) ps->nodes[n].set['\n' >> 3] &= ~(1 << ('\n' & 7));
+      return node(ps, N_ALT, n, multibyte(ps));
+
+    case '^':
+      return node(ps, N_BOL, -1, -1);
+
+    case '$':
+      return node(ps, N_EOL, -1, -1);
+
+    case '*': case '+': case '?':
+      ps->error = 1;
+      return -1;
+
+    case '\\':
+      if (!*ps->p) {
+        ps->error = 1;
+        return -1;
+      }
+      c = (unsigned char) *ps->p++;
+      n = node(ps, N_SET, -1, -1);
+      if (n >= 0 && !char_class(c | 0x20, ps->nodes[n].set)) {
+        c = escaped(c);
+        ADD(ps->nodes[n].set, c);
+      } else if (n >= 0 && c >= 'A' && c <= 'Z') {
+        // \D, \S and \W match what their lowercase class does not
+        for (i = 0; i < 32; i++) ps->nodes[n].set[i] ^= 0xFF;
+        for (i = 16; i < 32; i++) ps->nodes[n].set[i] = 0;
+        return node(ps, N_ALT, n, multibyte(ps));
+      }
+      return n;
+
+    default:
+      // A multibyte character is repeated as a whole
+      len = utf8_length(c);
+      n = byte_range(ps, c, c);
+      for (i = 1; i < len && (unsigned char) *ps->p >= 0x80; i++) {
+        c = (unsigned char) *ps->p++;
+        n = cat(ps, n, byte_range(ps, c, c));
+      }
+      return n;
+  }
+}
+
+static int parse_repeat(struct parser *ps) {
+  int n = parse_atom(ps);
+  int type;
+
+  while (!ps->error && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?')) {
+    type = *ps->p == '*' ? N_STAR : *ps->p == '+' ? N_PLUS : N_QUEST;
+    n = node(ps, type, n, -1);
+    if (*++ps->p == '?') {
+      ps->p++;
+      if (n >= 0) ps->nodes[n].greedy = 0;
+    }
+  }
+  return n;
+}
+
+static int parse_concat(struct parser *ps) {
+  int n = -1;
+
+  while (!ps->error && *ps->p && *ps->p != '|' && *ps->p != ')') n = cat(ps, n, parse_repeat(ps));
+  return n < 0 ? node(ps, N_EMPTY, -1, -1) : n;
+}
+
+static int parse_alt(struct parser *ps) {
+  int n = parse_concat(ps);
+
+  while (!ps->error && *ps->p == '|') {
+    ps->p++;
+    n = node(ps, N_ALT, n, parse_concat(ps));
+  }
+  return n;
+}
+
+static int literal_prefix(struct parser *ps, int n, char *prefix, int *len) {
+ /**
+  * Collects the bytes every match of node n starts with
+  * @return Nonzero if the node matches nothing but those bytes
+  */
+  struct rnode *node = &ps->nodes[n];
+  int c, only = -1;
+
+  switch (node->type) {
+    case N_CAT:
+      return literal_prefix(ps, node->a, prefix, len) && literal_prefix(ps, node->b, prefix, len);
+
+    case N_SET:
+      for (c = 0; c < 256; c++) {
+        if (!HAS(node->set, c)) continue;
+        if (only >= 0) return 0;
+        only = c;
+      }
+      if (only < 0 || *len == MAX_PREFIX) return 0;
+      prefix[(*len)++] = only;
+      return 1;
+
+    case N_BOL: case N_EOL: case N_EMPTY:
+      return 1;
+
+    default:
+      return 0;
+  }
+}
+
+//
+// Compiler
+//
+
+static int inst(struct rprog *prog, int op, int out, int out1) {
+  struct rinst *in = &prog->insts[prog->num_insts];
+
+  memset(in, 0, sizeof(struct rinst));
+  in->op = op;
+  in->out = out;
+  in->out1 = out1;
+  return prog->num_insts++;
+}
+
+static int compile(struct rprog *prog, struct parser *ps, int n, int next, int reverse) {
+ /**
+  * Compiles node n, continuing at instruction next once it has matched.
+  * Concatenations are compiled back to front for reverse programs.
+  * @return The first instruction of the node
+  */
+  struct rnode *node = &ps->nodes[n];
+  int loop, body;
+
+  switch (node->type) {
+    case N_SET:
+      body = inst(prog, R_BYTE, next, -1);
+      memcpy(prog->insts[body].set, node->set, 32);
+      return body;
+
+    case N_CAT:
+      if (reverse) return compile(prog, ps, node->b, compile(prog, ps, node->a, next, reverse), reverse);
+      return compile(prog, ps, node->a, compile(prog, ps, node->b, next, reverse), reverse);
+
+    case N_ALT:
+      body = compile(prog, ps, node->a, next, reverse);
+      return inst(prog, R_SPLIT, body, compile(prog, ps, node->b, next, reverse));
+
+    case N_STAR: case N_PLUS:
+      loop = inst(prog, R_SPLIT, -1, -1);
+      body = compile(prog, ps, node->a, loop, reverse);
+      prog->insts[loop].out = node->greedy ? body : next;
+      prog->insts[loop].out1 = node->greedy ? next : body;
+      return node->type == N_STAR ? loop : body;
+
+    case N_QUEST:
+      body = compile(prog, ps, node->a, next, reverse);
+      return node->greedy ? inst(prog, R_SPLIT, body, next) : inst(prog, R_SPLIT, next, body);
+
+    case N_BOL: case N_EOL:
+      // Looking backwards the start of a line is where the end was
+      return inst(prog, (node->type == N_BOL) != reverse ? R_BOL : R_EOL, next, -1);
+
+    default:
+      return next;
+  }
+}
+
+static void free_states(struct rprog *prog) {
+  struct dstate *s, *next;
+  int i;
+
+  for (i = 0; i < DFA_HASH; i++) {
+    for (s = prog->table[i]; s; s = next) {
+      next = s->chain;
+      free(s);
+    }
+    prog->table[i] = NULL;
+  }
+  prog->num_states = 0;
+  prog->flushes++;
+  prog->starts[0] = prog->starts[1] = NULL;
+}
+
+static void free_prog(struct rprog *prog) {
+  if (!prog) return;
+  free_states(prog);
+  free(prog->insts);
+  free(prog->mark);
+  free(prog->list);
+  free(prog->kernel);
+  free(prog);
+}
+
+static struct rprog *new_prog(struct parser *ps, int root, int reverse) {
+ /**
+  * Compiles the parsed pattern. The forward program also has a loop of
+  * lowest priority that starts a new attempt at every byte.
+  */
+  struct rprog *prog = calloc(1, sizeof(struct rprog));
+  int size = ps->num_nodes + 3;
+  int match, any;
+
+  if (!prog) return NULL;
+  prog->insts = malloc(size * sizeof(struct rinst));
+  prog->mark = calloc(size, sizeof(int));
+  prog->list = malloc(size * sizeof(int));
+  prog->kernel = malloc(size * sizeof(int));
+  if (!prog->insts || !prog->mark || !prog->list || !prog->kernel) {
+    free_prog(prog);
+    return NULL;
+  }
+
+  match = inst(prog, R_MATCH, -1, -1);
+  prog->start = compile(prog, ps, root, match, reverse);
+  prog->longest = reverse;
+  if (!reverse) {
+    any = inst(prog, R_BYTE, -1, -1);
+    memset(prog->insts[any].set, 0xFF, 32);
+    prog->start = inst(prog, R_SPLIT, prog->start, any);
+    prog->insts[any].out = prog->start;
+  }
+  return prog;
+}
+
+struct regex *regex_compile(const char *pattern) {
+ /**
+  * Compiles pattern, which may use . [] [^] * + ? *? +? ?? | () ^ $ and the
+  * escapes \d \w \s \D \W \S \n \t
+  * @return The regular expression, or NULL if the pattern is not valid
+  */
+  struct parser ps = {pattern, NULL, 0, 0, 0};
+  struct regex *re;
+  int root;
+
+  root = parse_alt(&ps);
+  if (*ps.p || root < 0) ps.error = 1;
+
+  re = ps.error ? NULL : calloc(1, sizeof(struct regex));
+  if (re) {
+    literal_prefix(&ps, root, re->prefix, &re->prefix_len);
+    re->forward = new_prog(&ps, root, 0);
+    re->reverse = new_prog(&ps, root, 1);
+    if (!re->forward || !re->reverse) {
+      regex_free(re);
+      re = NULL;
+    }
+  }
+
+  free(ps.nodes);
+  return re;
+}
+
+void regex_free(struct regex *re) {
+  if (!re) return;
+  free_prog(re->forward);
+  free_prog(re->reverse);
+  free(re);
+}
+
+//
+// Lazy DFA
+//
+
+static void follow(struct rprog *prog, int i, int bol, int eol, int *list, int *len, int *matched) {
+  // Adds the instructions reachable from i without reading a byte
+  struct rinst *in = &prog->insts[i];
+
+  if (*matched && !prog->longest) return;
+  if (prog->mark[i] == prog->markgen) return;
+  prog->mark[i] = prog->markgen;
+
+  switch (in->op) {
+    case R_SPLIT:
+      follow(prog, in->out, bol, eol, list, len, matched);
+      follow(prog, in->out1, bol, eol, list, len, matched);
+      break;
+    case R_BOL:
+      if (bol) follow(prog, in->out, bol, eol, list, len, matched);
+      break;
+    case R_EOL:
+      if (eol) follow(prog, in->out, bol, eol, list, len, matched);
+      break;
+    case R_MATCH:
+      *matched = 1;
+      break;
+    default:
+      list[(*len)++] = i;
+  }
+}
+
+static int closure(struct rprog *prog, int *kernel, int num_kernel, int bol, int eol, int *matched) {
+ /**
+  * Follows the kernel into prog->list, stopping at the first match unless
+  * the longest match is wanted
+  * @return The number of instructions in the list
+  */
+  int i, len = 0;
+
+  *matched = 0;
+  prog->markgen++;
+  for (i = 0; i < num_kernel; i++) follow(prog, kernel[i], bol, eol, prog->list, &len, matched);
+  return len;
+}
+
+static struct dstate *intern(struct rprog *prog, int *kernel, int num_kernel, int bol) {
+ /**
+  * Finds or adds the state for kernel, flushing the cache when it is full
+  * @return The state, or NULL if out of memory
+  */
+  struct dstate *s;
+  unsigned hash = bol;
+  int i;
+
+  for (i = 0; i < num_kernel; i++) hash = hash * 31 + kernel[i];
+  for (s = prog->table[hash % DFA_HASH]; s; s = s->chain) {
+    if (s->hash == hash && s->bol == bol && s->num_kernel == num_kernel && !memcmp(s->kernel, kernel, num_kernel * sizeof(int))) return s;
+  }
+
+  if (prog->num_states == DFA_STATES) free_states(prog);
+
+  s = malloc(sizeof(struct dstate) + num_kernel * sizeof(int));
+  if (!s) return NULL;
+  memset(s->next, 0, sizeof(s->next));
+  s->bol = bol;
+  s->hash = hash;
+  s->num_kernel = num_kernel;
+  s->kernel = (int *) (s + 1);
+  memcpy(s->kernel, kernel, num_kernel * sizeof(int));
+  closure(prog, kernel, num_kernel, bol, 0, &s->matched[0]);
+  closure(prog, kernel, num_kernel, bol, 1, &s->matched[1]);
+
+  s->chain = prog->table[hash % DFA_HASH];
+  prog->table[hash % DFA_HASH] = s;
+  prog->num_states++;
+  return s;
+}
+
+static struct dstate *start_state(struct rprog *prog, int bol) {
+  if (!prog->starts[bol]) prog->starts[bol] = intern(prog, &prog->start, 1, bol);
+  return prog->starts[bol];
+}
+
+static struct dstate *step(struct rprog *prog, struct dstate *s, int c) {
+ /**
+  * Moves from s on byte c, working the transition out the first time
+  * @return The next state, or NULL if out of memory
+  */
+  struct dstate *next;
+  int len, matched, i, out, num_kernel = 0;
+  int flushes = prog->flushes;
+
+  if (s->next[c]) return s->next[c];
+
+  len = closure(prog, s->kernel, s->num_kernel, s->bol, c == '\n', &matched);
+  prog->markgen++;
+  for (i = 0; i < len; i++) {
+    out = prog->insts[prog->list[i]].out;
+    if (HAS(prog->insts[prog->list[i]].set, c) && prog->mark[out] != prog->markgen) {
+      prog->mark[out] = prog->markgen;
+      prog->kernel[num_kernel++] = out;
+    }
+  }
+
+  // A flush frees s along with the rest of the cache
+  next = intern(prog, prog->kernel, num_kernel, c == '\n');
+  if (next && prog->flushes == flushes) s->next[c] = next;
+  return next;
+}
+
+//
+// Search
+//
+
+static int matches_before(struct dstate *s, int c) {
+  return s->matched[c == '\n' || c == END_OF_TEXT];
+}
+
+int regex_search(struct regex *re, const char *text, int len, int pos, int *end) {
+ /**
+  * Finds the leftmost match starting at or after pos in the len bytes at
+  * text. A forward pass finds where the match ends and a backward pass from
+  * there where it starts, each in time linear in the bytes scanned.
+  * @return The start of the match with its end in *end, or -1 if there is none
+  */
+  struct rprog *prog = re->forward;
+  struct dstate *s;
+  int i, c, found, match_end = -1, match_start = -1;
+
+  if (pos < 0 || pos > len) return -1;
+
+  s = start_state(prog, pos == 0 || text[pos - 1] == '\n');
+  for (i = pos; s; i++) {
+    // Nothing is under way, so skip to where the literal prefix occurs
+    if (re->prefix_len && s->num_kernel == 1 && s->kernel[0] == prog->start) {
+      found = search_text(text + i, len - i, re->prefix, re->prefix_len);
+      if (found < 0) return -1;
+      i += found;
+      s = start_state(prog, i == 0 || text[i - 1] == '\n');
+      if (!s) break;
+    }
+
+    c = i < len ? (unsigned char) text[i] : END_OF_TEXT;
+    if (matches_before(s, c)) match_end = i;
+    if (i == len || !(s = step(prog, s, c)) || !s->num_kernel) break;
+  }
+  if (match_end < 0) return -1;
+
+  prog = re->reverse;
+  s = start_state(prog, match_end == len || text[match_end] == '\n');
+  for (i = match_end; s; i--) {
+    c = i > 0 ? (unsigned char) text[i - 1] : END_OF_TEXT;
+    if (matches_before(s, c)) match_start = i;
+    if (i == pos || !(s = step(prog, s, c)) || !s->num_kernel) break;
+  }
+  if (match_start < 0) return -1;
+
+  *end = match_end;
+  return match_start;
+}
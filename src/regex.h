@@ -0,0 +1,14 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+typedef struct regex regex;
+int regex_search(struct regex *re,const char *text,int len,int pos,int *end);
+void regex_free(struct regex *re);
+struct regex *regex_compile(const char *pattern);
+#define MAX_PREFIX     64
+struct regex {
+  struct rprog *forward;     // Finds where the leftmost match ends
+  struct rprog *reverse;     // Finds where the match ending there starts
+  char prefix[MAX_PREFIX];   // Text every match starts with
+  int prefix_len;
+};
+#define INTERFACE 0
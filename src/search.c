@@ -0,0 +1,410 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "search.h"
+#include "unicode.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SEARCH_SIMD
+#endif
+
+#define TWOWAY_MIN     32    // Needles at least this long may fall back to Two-Way
+#define TWOWAY_SLACK   65536
+
+#define MAX(a, b)      ((a) > (b) ? (a) : (b))
+#define LOWER(c)       ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+#define LETTER(c)      (LOWER(c) >= 'a' && LOWER(c) <= 'z')
+
+static int twoway(const unsigned char *h, int hlen, const unsigned char *n, int nlen) {
+ /**
+  * Crochemore-Perrin Two-Way search, linear in the length of the haystack
+  * whatever the needle
+  */
+  int shift[256];
+  int i, j, k, p, p0, ms, period, mem, mem0, pos;
+
+  // Distance from the last occurrence of each byte to the end of the needle
+  for (i = 0; i < 256; i++) shift[i] = nlen;
+  for (i = 0; i < nlen; i++) shift[n[i]] = nlen - 1 - i;
+
+  // Critical factorization: the longer of the maximal suffixes for both orders
+  i = -1; j = 0; k = p = 1;
+  while (j + k < nlen) {
+    if (n[i + k] == n[j + k]) {
+      if (k == p) {
+        j += p;
+        k = 1;
+      } else {
+        k++;
+      }
+    } else if (n[i + k] > n[j + k]) {
+      j += k;
+      k = 1;
+      p = j - i;
+    } else {
+      i = j++;
+      k = p = 1;
+    }
+  }
+  ms = i;
+  p0 = p;
+
+  i = -1; j = 0; k = p = 1;
+  while (j + k < nlen) {
+    if (n[i + k] == n[j + k]) {
+      if (k == p) {
+        j += p;
+        k = 1;
+      } else {
+        k++;
+      }
+    } else if (n[i + k] < n[j + k]) {
+      j += k;
+      k = 1;
+      p = j - i;
+    } else {
+      i = j++;
+      k = p = 1;
+    }
+  }
+  if (i > ms) {
+    ms = i;
+  } else {
+    p = p0;
+  }
+
+  // A periodic needle remembers how much of it already matched
+  if (memcmp(n, n + p, ms + 1)) {
+    period = MAX(ms + 1, nlen - ms - 1) + 1;
+    mem0 = 0;
+  } else {
+    period = p;
+    mem0 = nlen - p;
+  }
+
+  mem = 0;
+  pos = 0;
+  while (pos <= hlen - nlen) {
+    // Skip ahead on the last byte first
+    k = shift[h[pos + nlen - 1]];
+    if (k) {
+      if (k < mem) k = mem;
+      pos += k;
+      mem = 0;
+      continue;
+    }
+
+    // Right half
+    for (k = MAX(ms + 1, mem); k < nlen && n[k] == h[pos + k]; k++);
+    if (k < nlen) {
+      pos += k - ms;
+      mem = 0;
+      continue;
+    }
+
+    // Left half
+    for (k = ms + 1; k > mem && n[k - 1] == h[pos + k - 1]; k--);
+    if (k <= mem) return pos;
+    pos += period;
+    mem = mem0;
+  }
+
+  return -1;
+}
+
+static int same_any_case(const char *a, const char *b, int len) {
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (LOWER(a[i]) != LOWER(b[i])) return 0;
+  }
+  return 1;
+}
+
+static int same(const char *a, const char *b, int len, int fold) {
+  return fold ? same_any_case(a, b, len) : !memcmp(a, b, len);
+}
+
+static int scan(const char *h, int hlen, const char *n, int nlen, int start, int fold) {
+  // Checks the positions from start onwards one at a time
+  const char *p = h + start;
+  const char *end = h + hlen - nlen + 1;
+
+  if (fold) {
+    for (; p < end; p++) {
+      if (LOWER(p[0]) == LOWER(n[0]) && same_any_case(p + 1, n + 1, nlen - 1)) return p - h;
+    }
+    return -1;
+  }
+
+  while (p < end && (p = memchr(p, n[0], end - p))) {
+    if (p[nlen - 1] == n[nlen - 1] && !memcmp(p + 1, n + 1, nlen - 2)) return p - h;
+    p++;
+  }
+  return -1;
+}
+
+static int rscan(const char *h, const char *n, int nlen, int end, int fold) {
+  // Checks the positions before end one at a time, the last first
+  const char *p;
+  int i;
+
+  if (fold) {
+    for (i = end - 1; i >= 0; i--) {
+      if (LOWER(h[i]) == LOWER(n[0]) && same_any_case(h + i + 1, n + 1, nlen - 1)) return i;
+    }
+    return -1;
+  }
+
+  while (end > 0 && (p = memrchr(h, n[0], end))) {
+    if (!memcmp(p + 1, n + 1, nlen - 1)) return p - h;
+    end = p - h;
+  }
+  return -1;
+}
+
+#ifdef SEARCH_SIMD
+
+static int filter_sse2(const char *h, int hlen, const char *n, int nlen, int *resume, int fold) {
+ /**
+  * Compares 16 positions at a time against the first and last byte of the
+  * needle, and only checks the rest of the needle where both match. Letters
+  * are compared in lowercase when folding, by setting the 0x20 bit of the
+  * text. Gives up with the position in *resume if a long needle matches
+  * partially so often that the checks cost more than Two-Way would.
+  */
+  int f = fold && LETTER(n[0]) ? 0x20 : 0;
+  int l = fold && LETTER(n[nlen - 1]) ? 0x20 : 0;
+  __m128i first = _mm_set1_epi8(n[0] | f);
+  __m128i last = _mm_set1_epi8(n[nlen - 1] | l);
+  __m128i first_fold = _mm_set1_epi8(f);
+  __m128i last_fold = _mm_set1_epi8(l);
+  __m128i a, b;
+  unsigned mask;
+  long checked = 0;
+  int i, bit;
+
+  for (i = 0; i + nlen - 1 + 16 <= hlen; i += 16) {
+    a = _mm_or_si128(_mm_loadu_si128((const __m128i *) (h + i)), first_fold);
+    b = _mm_or_si128(_mm_loadu_si128((const __m128i *) (h + i + nlen - 1)), last_fold);
+    mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      bit = __builtin_ctz(mask);
+      checked++;
+      if (same(h + i + bit + 1, n + 1, nlen - 2, fold)) return i + bit;
+      mask &= mask - 1;
+    }
+    if (!fold && nlen >= TWOWAY_MIN && checked * nlen > i + TWOWAY_SLACK) {
+      *resume = i;
+      return -1;
+    }
+  }
+
+  return scan(h, hlen, n, nlen, i, fold);
+}
+
+__attribute__((target("avx2")))
+static int filter_avx2(const char *h, int hlen, const char *n, int nlen, int *resume, int fold) {
+  int f = fold && LETTER(n[0]) ? 0x20 : 0;
+  int l = fold && LETTER(n[nlen - 1]) ? 0x20 : 0;
+  __m256i first = _mm256_set1_epi8(n[0] | f);
+  __m256i last = _mm256_set1_epi8(n[nlen - 1] | l);
+  __m256i first_fold = _mm256_set1_epi8(f);
+  __m256i last_fold = _mm256_set1_epi8(l);
+  __m256i a, b;
+  unsigned mask;
+  long checked = 0;
+  int i, bit;
+
+  for (i = 0; i + nlen - 1 + 32 <= hlen; i += 32) {
+    a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (h + i)), first_fold);
+    b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (h + i + nlen - 1)), last_fold);
+    mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+    while (mask) {
+      bit = __builtin_ctz(mask);
+      checked++;
+      if (same(h + i + bit + 1, n + 1, nlen - 2, fold)) return i + bit;
+      mask &= mask - 1;
+    }
+    if (!fold && nlen >= TWOWAY_MIN && checked * nlen > i + TWOWAY_SLACK) {
+      *resume = i;
+      return -1;
+    }
+  }
+
+  return scan(h, hlen, n, nlen, i, fold);
+}
+
+static int rfilter_sse2(const char *h, int hlen, const char *n, int nlen, int fold) {
+ /**
+  * Runs the filter backwards from the end of the text, taking the
+  * candidates in each block from the highest position down
+  */
+  int f = fold && LETTER(n[0]) ? 0x20 : 0;
+  int l = fold && LETTER(n[nlen - 1]) ? 0x20 : 0;
+  __m128i first = _mm_set1_epi8(n[0] | f);
+  __m128i last = _mm_set1_epi8(n[nlen - 1] | l);
+  __m128i first_fold = _mm_set1_epi8(f);
+  __m128i last_fold = _mm_set1_epi8(l);
+  __m128i a, b;
+  unsigned mask;
+  int i = hlen - nlen + 1;
+  int bit;
+
+  while (i >= 16) {
+    i -= 16;
+    a = _mm_or_si128(_mm_loadu_si128((const __m128i *) (h + i)), first_fold);
+    b = _mm_or_si128(_mm_loadu_si128((const __m128i *) (h + i + nlen - 1)), last_fold);
+    mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      bit = 31 - __builtin_clz(mask);
+      if (same(h + i + bit + 1, n + 1, nlen - 2, fold)) return i + bit;
+      mask &= ~(1u << bit);
+    }
+  }
+
+  return rscan(h, n, nlen, i, fold);
+}
+
+__attribute__((target("avx2")))
+static int rfilter_avx2(const char *h, int hlen, const char *n, int nlen, int fold) {
+  int f = fold && LETTER(n[0]) ? 0x20 : 0;
+  int l = fold && LETTER(n[nlen - 1]) ? 0x20 : 0;
+  __m256i first = _mm256_set1_epi8(n[0] | f);
+  __m256i last = _mm256_set1_epi8(n[nlen - 1] | l);
+  __m256i first_fold = _mm256_set1_epi8(f);
+  __m256i last_fold = _mm256_set1_epi8(l);
+  __m256i a, b;
+  unsigned mask;
+  int i = hlen - nlen + 1;
+  int bit;
+
+  while (i >= 32) {
+    i -= 32;
+    a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (h + i)), first_fold);
+    b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (h + i + nlen - 1)), last_fold);
+    mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+    while (mask) {
+      bit = 31 - __builtin_clz(mask);
+      if (same(h + i + bit + 1, n + 1, nlen - 2, fold)) return i + bit;
+      mask &= ~(1u << bit);
+    }
+  }
+
+  return rscan(h, n, nlen, i, fold);
+}
+
+#endif
+
+int search_text(const char *text, int len, const char *needle, int nlen) {
+ /**
+  * Finds the first occurrence of needle in the len bytes at text
+  * @return The offset of the match, or -1 if there is none
+  */
+  const char *p;
+  int pos, resume = -1;
+
+  if (nlen <= 0) return 0;
+  if (nlen > len) return -1;
+
+  if (nlen == 1) {
+    p = memchr(text, needle[0], len);
+    return p ? p - text : -1;
+  }
+
+#ifdef SEARCH_SIMD
+  if (__builtin_cpu_supports("avx2")) {
+    pos = filter_avx2(text, len, needle, nlen, &resume, 0);
+  } else {
+    pos = filter_sse2(text, len, needle, nlen, &resume, 0);
+  }
+#else
+  if (nlen < TWOWAY_MIN) return scan(text, len, needle, nlen, 0, 0);
+  resume = 0;
+#endif
+
+  if (resume < 0) return pos;
+
+  // Two-Way keeps the search linear whatever the needle
+  pos = twoway((const unsigned char *) text + resume, len - resume, (const unsigned char *) needle, nlen);
+  return pos < 0 ? -1 : resume + pos;
+}
+
+static int same_folded(const char *text, int len, const char *needle, int nlen) {
+  // Compares character by character, as foldings keep the encoded length
+  int i, n, cp, ncp;
+
+  if (nlen > len) return 0;
+  for (i = 0; i < nlen; i += n) {
+    n = utf8_decode(needle + i, nlen - i, &ncp);
+    if (n == 1) {
+      // ASCII, or a byte that is not valid UTF-8 and must match exactly
+      if (LOWER(text[i]) != LOWER(needle[i])) return 0;
+    } else if (utf8_decode(text + i, nlen - i, &cp) != n || fold_case(cp) != fold_case(ncp)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int search_any_case(const char *text, int len, const char *needle, int nlen) {
+ /**
+  * Finds the first occurrence of needle in the len bytes at text ignoring
+  * case. ASCII needles are folded inside the vectorized filter; any other
+  * needle is compared a character at a time.
+  * @return The offset of the match, or -1 if there is none
+  */
+  int i, resume;
+
+  if (nlen <= 0) return 0;
+  if (nlen > len) return -1;
+
+  for (i = 0; i < nlen && !(needle[i] & 0x80); i++);
+  if (i < nlen) {
+    for (i = 0; i <= len - nlen; i++) {
+      if (!utf8_continuation(text[i]) && same_folded(text + i, len - i, needle, nlen)) return i;
+    }
+    return -1;
+  }
+
+#ifdef SEARCH_SIMD
+  if (__builtin_cpu_supports("avx2")) return filter_avx2(text, len, needle, nlen, &resume, 1);
+  return filter_sse2(text, len, needle, nlen, &resume, 1);
+#else
+  (void) resume;
+  return scan(text, len, needle, nlen, 0, 1);
+#endif
+}
+
+int search_last(const char *text, int len, const char *needle, int nlen, int any_case) {
+ /**
+  * Finds the last occurrence of needle in the len bytes at text, optionally
+  * ignoring case, by running the search kernels from the end backwards
+  * @return The offset of the match, or -1 if there is none
+  */
+  int i;
+
+  if (nlen <= 0) return len;
+  if (nlen > len) return -1;
+
+  if (any_case) {
+    for (i = 0; i < nlen && !(needle[i] & 0x80); i++);
+    if (i < nlen) {
+      for (i = len - nlen; i >= 0; i--) {
+        if (!utf8_continuation(text[i]) && same_folded(text + i, len - i, needle, nlen)) return i;
+      }
+      return -1;
+    }
+  } else if (nlen == 1) {
+    return rscan(text, needle, 1, len, 0);
+  }
+
+#ifdef SEARCH_SIMD
+  if (__builtin_cpu_supports("avx2")) return rfilter_avx2(text, len, needle, nlen, any_case);
+  return rfilter_sse2(text, len, needle, nlen, any_case);
+#else
+  return rscan(text, needle, nlen, len - nlen + 1, any_case);
+#endif
+}
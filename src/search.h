@@ -0,0 +1,5 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+int search_last(const char *text,int len,const char *needle,int nlen,int any_case);
+int search_any_case(const char *text,int len,const char *needle,int nlen);
+int search_text(const char *text,int len,const char *needle,int nlen);
@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "snapshot.h"
+
+#if INTERFACE
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// A stretch of a snapshot, either still in the live buffer, possibly moved
+// by later edits, or copied out before an edit removed it
+struct piece {
+  int start;                 // Position in the snapshot
+  int length;
+  int live;                  // Position in the live buffer, or -1 once copied
+  char *copy;
+};
+
+struct snapshot {
+  atomic_int refs;
+  const char *live;          // Buffer the snapshot was taken of
+  int length;
+  unsigned generation;       // Buffer generation at the time of the snapshot
+  int num_pieces;
+  int max_pieces;
+  struct piece *pieces;      // The whole snapshot in order
+  atomic_int broken;         // Text about to be removed could not be copied
+  pthread_mutex_t lock;      // Held while the pieces or the live buffer change
+  struct snapshot *next;
+};
+
+#endif
+
+// Snapshots sharing text with a live buffer
+static struct snapshot *snapshots;
+static pthread_mutex_t snapshots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct snapshot *take_snapshot(const char *live, int length, unsigned generation) {
+ /**
+  * Takes a snapshot of the first length bytes of live. Nothing is copied
+  * until the live buffer changes.
+  * @return The snapshot with one reference, or NULL if out of memory
+  */
+  struct snapshot *snap = calloc(1, sizeof(struct snapshot));
+
+  if (!snap) return NULL;
+  snap->pieces = malloc(sizeof(struct piece));
+  if (!snap->pieces) {
+    free(snap);
+    return NULL;
+  }
+  snap->max_pieces = 1;
+  if (length > 0) {
+    snap->pieces[0].start = 0;
+    snap->pieces[0].length = length;
+    snap->pieces[0].live = 0;
+    snap->pieces[0].copy = NULL;
+    snap->num_pieces = 1;
+  }
+
+  atomic_init(&snap->refs, 1);
+  snap->live = live;
+  snap->length = length;
+  snap->generation = generation;
+  pthread_mutex_init(&snap->lock, NULL);
+
+  pthread_mutex_lock(&snapshots_lock);
+  snap->next = snapshots;
+  snapshots = snap;
+  pthread_mutex_unlock(&snapshots_lock);
+  return snap;
+}
+
+void retain_snapshot(struct snapshot *snap) {
+  atomic_fetch_add(&snap->refs, 1);
+}
+
+void release_snapshot(struct snapshot *snap) {
+  struct snapshot **link;
+  int i;
+
+  if (!snap || atomic_fetch_sub(&snap->refs, 1) > 1) return;
+
+  pthread_mutex_lock(&snapshots_lock);
+  for (link = &snapshots; *link && *link != snap; link = &(*link)->next);
+  if (*link) *link = snap->next;
+  pthread_mutex_unlock(&snapshots_lock);
+
+  for (i = 0; i < snap->num_pieces; i++) free(snap->pieces[i].copy);
+  free(snap->pieces);
+  pthread_mutex_destroy(&snap->lock);
+  free(snap);
+}
+
+static int split(struct snapshot *snap, int i, int at) {
+ /**
+  * Splits piece i in two, the second starting at offset at of the first
+  * @return Zero if out of memory
+  */
+  struct piece *p;
+
+  if (snap->num_pieces == snap->max_pieces) {
+    p = realloc(snap->pieces, 2 * snap->max_pieces * sizeof(struct piece));
+    if (!p) return 0;
+    snap->pieces = p;
+    snap->max_pieces *= 2;
+  }
+
+  p = &snap->pieces[i];
+  memmove(p + 1, p, (snap->num_pieces - i) * sizeof(struct piece));
+  snap->num_pieces++;
+  p[0].length = at;
+  p[1].start += at;
+  p[1].length -= at;
+  p[1].live += at;
+  return 1;
+}
+
+static void preserve(struct snapshot *snap, int pos, int len, int shift) {
+  // Copies the pieces in the removed bytes and moves those after them
+  struct piece *p;
+  int i;
+
+  for (i = 0; i < snap->num_pieces && !atomic_load(&snap->broken); i++) {
+    p = &snap->pieces[i];
+    if (p->copy || p->live + p->length <= pos) continue;
+
+    if (p->live >= pos + len) {
+      p->live += shift;
+    } else if (p->live < pos) {
+      // The part before pos stays, and the rest is the next piece
+      if (!split(snap, i, pos - p->live)) atomic_store(&snap->broken, 1);
+    } else {
+      if (p->live + p->length > pos + len && !split(snap, i, pos + len - p->live)) {
+        atomic_store(&snap->broken, 1);
+        break;
+      }
+      p = &snap->pieces[i];
+      p->copy = malloc(p->length);
+      if (!p->copy) {
+        atomic_store(&snap->broken, 1);
+        break;
+      }
+      memcpy(p->copy, snap->live + p->live, p->length);
+      p->live = -1;
+    }
+  }
+}
+
+void preserve_snapshots(const char *live, int pos, int len, int n) {
+ /**
+  * Must be called before the len bytes of live at pos are replaced with n
+  * others. Snapshots get copies of the bytes that go, and find the rest of
+  * their text where the change moves it. Readers wait until
+  * resume_snapshots() says the change is done.
+  */
+  struct snapshot *snap;
+
+  pthread_mutex_lock(&snapshots_lock);
+  for (snap = snapshots; snap; snap = snap->next) {
+    if (snap->live != live) continue;
+    pthread_mutex_lock(&snap->lock);
+    preserve(snap, pos, len, n - len);
+  }
+}
+
+void resume_snapshots(const char *live) {
+  struct snapshot *snap;
+
+  for (snap = snapshots; snap; snap = snap->next) {
+    if (snap->live == live) pthread_mutex_unlock(&snap->lock);
+  }
+  pthread_mutex_unlock(&snapshots_lock);
+}
+
+int read_snapshot(struct snapshot *snap, int pos, char *buf, int len) {
+ /**
+  * Copies up to len bytes of the snapshot starting at pos into buf. Safe to
+  * call from any thread holding a reference. Nothing is copied from a broken
+  * snapshot, as the live buffer no longer holds its text.
+  * @return The number of bytes copied
+  */
+  struct piece *p;
+  int lo, hi, mid, offset, n, done = 0;
+
+  if (len > snap->length - pos) len = snap->length - pos;
+  if (pos < 0 || len <= 0) return 0;
+
+  pthread_mutex_lock(&snap->lock);
+
+  // The last piece starting at or before pos holds it
+  lo = 0;
+  hi = snap->num_pieces - 1;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (snap->pieces[mid].start <= pos) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  for (p = &snap->pieces[lo]; done < len && !atomic_load(&snap->broken); p++) {
+    offset = pos + done - p->start;
+    n = p->length - offset < len - done ? p->length - offset : len - done;
+    memcpy(buf + done, p->copy ? p->copy + offset : snap->live + p->live + offset, n);
+    done += n;
+  }
+
+  pthread_mutex_unlock(&snap->lock);
+  return done;
+}
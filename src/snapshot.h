@@ -0,0 +1,31 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+#include <pthread.h>
+#include <stdatomic.h>
+typedef struct snapshot snapshot;
+int read_snapshot(struct snapshot *snap,int pos,char *buf,int len);
+void resume_snapshots(const char *live);
+void preserve_snapshots(const char *live,int pos,int len,int n);
+void release_snapshot(struct snapshot *snap);
+void retain_snapshot(struct snapshot *snap);
+struct snapshot *take_snapshot(const char *live,int length,unsigned generation);
+typedef struct piece piece;
+struct snapshot {
+  atomic_int refs;
+  const char *live;          // Buffer the snapshot was taken of
+  int length;
+  unsigned generation;       // Buffer generation at the time of the snapshot
+  int num_pieces;
+  int max_pieces;
+  struct piece *pieces;      // The whole snapshot in order
+  atomic_int broken;         // Text about to be removed could not be copied
+  pthread_mutex_t lock;      // Held while the pieces or the live buffer change
+  struct snapshot *next;
+};
+struct piece {
+  int start;                 // Position in the snapshot
+  int length;
+  int live;                  // Position in the live buffer, or -1 once copied
+  char *copy;
+};
+#define INTERFACE 0
@@ -0,0 +1,100 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "symbols.h"
+
+#if INTERFACE
+
+#define MAX_SYMBOLS    1024
+
+struct symbol {
+  int pos;                   // Where the name is in the text
+  int len;
+  int resume;                // Where parsing can pick up again after it, or -1
+  int defined;               // Zero for a prototype
+};
+
+// Functions, types, macros and variables in the order they are declared
+struct symbols {
+  int count;
+  struct symbol list[MAX_SYMBOLS];
+};
+
+#endif
+
+// Built from makeheaders.c, whose parser keeps its state in globals
+int ParseSymbols(const char *text, void (*symbol)(void *, const char *, int, int, int), void *arg);
+
+static pthread_mutex_t parser_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct parse {
+  struct symbols *symbols;
+  int from;
+};
+
+static void add_symbol(void *arg, const char *name, int pos, int resume, int defined) {
+  struct parse *parse = arg;
+  struct symbol *s;
+
+  if (parse->symbols->count == MAX_SYMBOLS) return;
+  s = &parse->symbols->list[parse->symbols->count++];
+  s->pos = parse->from + pos;
+  s->len = strlen(name);
+  s->resume = resume < 0 ? -1 : parse->from + resume;
+  s->defined = defined;
+}
+
+int parse_symbols(struct symbols *symbols, const char *text, int from) {
+ /**
+  * Adds the symbols declared in text, which starts at position from
+  * @return Zero on success, -1 if the text could not be tokenized
+  */
+  struct parse parse = {symbols, from};
+  int rc;
+
+  pthread_mutex_lock(&parser_lock);
+  rc = ParseSymbols(text, add_symbol, &parse);
+  pthread_mutex_unlock(&parser_lock);
+  return rc < 0 ? -1 : 0;
+}
+
+int keep_symbols(struct symbols *symbols, int pos) {
+ /**
+  * Drops the symbols a change at pos could affect, keeping those up to the
+  * last function that ends before it
+  * @return The position parsing has to resume from
+  */
+  int i;
+
+  for (i = symbols->count - 1; i >= 0; i--) {
+    if (symbols->list[i].resume >= 0 && symbols->list[i].resume <= pos) break;
+  }
+  symbols->count = i + 1;
+  return i < 0 ? 0 : symbols->list[i].resume;
+}
+
+void append_symbols(struct symbols *symbols, const struct symbols *more) {
+  int n = more->count;
+
+  if (n > MAX_SYMBOLS - symbols->count) n = MAX_SYMBOLS - symbols->count;
+  memcpy(symbols->list + symbols->count, more->list, n * sizeof(struct symbol));
+  symbols->count += n;
+}
+
+struct symbol *find_symbol(struct symbols *symbols, const char *text, const char *name) {
+ /**
+  * Looks name up, preferring a definition over a prototype
+  * @return The symbol, or NULL if there is none by that name
+  */
+  struct symbol *found = NULL;
+  int len = strlen(name);
+  int i;
+
+  for (i = 0; i < symbols->count; i++) {
+    struct symbol *s = &symbols->list[i];
+    if (s->len != len || memcmp(text + s->pos, name, len)) continue;
+    if (s->defined) return s;
+    if (!found) found = s;
+  }
+  return found;
+}
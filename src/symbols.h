@@ -0,0 +1,21 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+typedef struct symbol symbol;
+typedef struct symbols symbols;
+struct symbol {
+  int pos;                   // Where the name is in the text
+  int len;
+  int resume;                // Where parsing can pick up again after it, or -1
+  int defined;               // Zero for a prototype
+};
+#define MAX_SYMBOLS    1024
+struct symbols {
+  int count;
+  struct symbol list[MAX_SYMBOLS];
+};
+struct symbol *find_symbol(struct symbols *symbols,const char *text,const char *name);
+void append_symbols(struct symbols *symbols,const struct symbols *more);
+int keep_symbols(struct symbols *symbols,int pos);
+int parse_symbols(struct symbols *symbols,const char *text,int from);
+int ParseSymbols(const char *text,void(*symbol)(void *,const char *,int,int,int),void *arg);
+#define INTERFACE 0
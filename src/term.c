@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "term.h"
+#include "unicode.h"
+
+#if INTERFACE
+
+enum attributes {ATTR_TEXT, ATTR_SELECT, ATTR_STATUS, ATTR_MATCH, ATTR_KEYWORD};
+
+struct cell {
+  char text[6];              // UTF-8 bytes of the character and any combining marks
+  unsigned char width;       // Screen columns, 0 for the right half of a wide character
+  unsigned char attr;
+};
+
+#endif
+
+#define CELL_UNKNOWN   0xFF
+
+#define SEQ_EL         "\033[K"
+#define SEQ_CUP        "\033[%d;%dH"
+#define SEQ_CUP_ROW    "\033[%dH"
+#define SEQ_CUU        "\033[%dA"
+#define SEQ_CUD        "\033[%dB"
+#define SEQ_CUF        "\033[%dC"
+#define SEQ_CUB        "\033[%dD"
+#define SEQ_ECH        "\033[%dX"
+#define SEQ_REP        "\033[%db"
+
+static char *attr_codes[] = {
+  "\033[m",                  // ATTR_TEXT
+  "\033[0;1;7m",             // ATTR_SELECT
+  "\033[0;1;7m",             // ATTR_STATUS
+  "\033[0;30;43m",           // ATTR_MATCH
+  "\033[0;1;31m",            // ATTR_KEYWORD
+};
+
+int term_rep = 0;            // Terminal understands REP
+int term_frame_bytes = 0;    // Bytes sent by the last term_flush()
+
+static int rows, cols;
+static struct cell *back;    // Screen being drawn
+static struct cell *front;   // Screen as last sent to the terminal
+
+static int draw_row, draw_col, draw_attr;
+static int cursor_row, cursor_col;
+
+static int out_row, out_col; // Terminal cursor, -1 if unknown
+static int out_attr;         // Terminal attributes, -1 if unknown
+static int out_bytes;
+
+static void emit(const char *s, int len) {
+  fwrite(s, 1, len, stdout);
+  out_bytes += len;
+}
+
+static int digits(int n) {
+  int d = 1;
+  while (n >= 10) {
+    n /= 10;
+    d++;
+  }
+  return d;
+}
+
+static int seq_cost(int n) {
+  // Length of an escape sequence with a single numeric parameter
+  return n == 1 ? 3 : 3 + digits(n);
+}
+
+static int seq(char *buf, char *fmt, int n) {
+  // Formats a sequence with a single parameter, leaving out a parameter of 1
+  if (n == 1) {
+    char *p = strstr(fmt, "%d");
+    int len = p - fmt;
+    memcpy(buf, fmt, len);
+    strcpy(buf + len, p + 2);
+    return strlen(buf);
+  }
+  return sprintf(buf, fmt, n);
+}
+
+static int attr_cost(int attr) {
+  if (out_attr >= 0 && !strcmp(attr_codes[out_attr], attr_codes[attr])) return 0;
+  return strlen(attr_codes[attr]);
+}
+
+static void set_attr(int attr) {
+  if (attr_cost(attr)) emit(attr_codes[attr], strlen(attr_codes[attr]));
+  out_attr = attr;
+}
+
+static int horizontal(char *buf, int from, int to) {
+  int n = 0;
+  int back_cost;
+
+  if (to == from) return 0;
+  if (from >= 0 && to > from) return seq(buf, SEQ_CUF, to - from);
+
+  back_cost = from - to < 3 ? from - to : seq_cost(from - to);
+  if (from < 0 || 1 + (to > 0 ? seq_cost(to) : 0) < back_cost) {
+    buf[n++] = '\r';
+    if (to > 0) n += seq(buf + n, SEQ_CUF, to);
+  } else if (from - to < 3) {
+    while (from-- > to) buf[n++] = '\b';
+  } else {
+    n += seq(buf + n, SEQ_CUB, from - to);
+  }
+  return n;
+}
+
+static int vertical(char *buf, int from, int to) {
+  int n = 0;
+
+  if (to > from && to - from < 3) {
+    while (from++ < to) buf[n++] = '\n';
+  } else if (to > from) {
+    n += seq(buf + n, SEQ_CUD, to - from);
+  } else if (to < from) {
+    n += seq(buf + n, SEQ_CUU, from - to);
+  }
+  return n;
+}
+
+static int plan_move(char *buf, int row, int col) {
+ /**
+  * Picks the shortest sequence that moves the terminal cursor to row, col
+  * @return The length of the sequence written to buf
+  */
+  char rel[64];
+  int n, len;
+
+  if (col == 0) {
+    len = row == 0 ? sprintf(buf, "\033[H") : sprintf(buf, SEQ_CUP_ROW, row + 1);
+  } else {
+    len = sprintf(buf, SEQ_CUP, row + 1, col + 1);
+  }
+
+  if (out_row >= 0) {
+    n = vertical(rel, out_row, row);
+    n += horizontal(rel + n, out_col, col);
+    if (n < len) {
+      memcpy(buf, rel, n);
+      len = n;
+    }
+  }
+
+  return len;
+}
+
+static int move_cost(int row, int col) {
+  char buf[64];
+  if (row == out_row && col == out_col) return 0;
+  return plan_move(buf, row, col);
+}
+
+static void move_to(int row, int col) {
+  char buf[64];
+  if (row == out_row && col == out_col) return;
+  emit(buf, plan_move(buf, row, col));
+  out_row = row;
+  out_col = col;
+}
+
+static int same(struct cell *a, struct cell *b) {
+  return a->width == b->width && a->attr == b->attr && !memcmp(a->text, b->text, sizeof(a->text));
+}
+
+static int blank(struct cell *c) {
+  return c->width == 1 && c->attr == ATTR_TEXT && c->text[0] == ' ' && !c->text[1];
+}
+
+static int text_len(struct cell *c) {
+  return strnlen(c->text, sizeof(c->text));
+}
+
+static void put_cell(int row, int col) {
+  struct cell *b = back + row * cols + col;
+  struct cell *f = front + row * cols + col;
+
+  move_to(row, col);
+  set_attr(b->attr);
+  emit(b->text, text_len(b));
+  f[0] = b[0];
+  if (b->width == 2) f[1] = b[1];
+
+  out_col += b->width;
+  if (out_col >= cols) out_col = -1;
+}
+
+static int run_length(struct cell *b, int start, int end) {
+  int n = 1;
+  while (start + n <= end && same(&b[start + n], &b[start])) n++;
+  return n;
+}
+
+static void flush_row(int row) {
+  struct cell *b = back + row * cols;
+  struct cell *f = front + row * cols;
+  char buf[32];
+  int first, last, tail, col, n, i, cost;
+
+  for (first = 0; first < cols && same(&b[first], &f[first]); first++);
+  if (first == cols) return;
+  for (last = cols - 1; same(&b[last], &f[last]); last--);
+
+  // Never split a wide character
+  while (first > 0 && (b[first].width == 0 || f[first].width == 0)) first--;
+  while (last + 1 < cols && (b[last + 1].width == 0 || f[last + 1].width == 0)) last++;
+
+  for (tail = cols; tail > 0 && blank(&b[tail - 1]); tail--);
+
+  col = first;
+  while (col <= last) {
+    if (col >= tail && last - col + 1 > 3) {
+      // Rest of the row is blank
+      move_to(row, col);
+      set_attr(ATTR_TEXT);
+      emit(SEQ_EL, strlen(SEQ_EL));
+      for (i = col; i < cols; i++) f[i] = b[i];
+      break;
+    }
+
+    if (same(&b[col], &f[col])) {
+      // Unchanged cells: either move past them or write them again
+      for (n = 1; col + n <= last && same(&b[col + n], &f[col + n]); n++);
+      cost = attr_cost(b[col].attr);
+      for (i = col; i < col + n; i++) {
+        cost += b[i].attr == b[col].attr ? text_len(&b[i]) : cols * 8;
+      }
+      if (out_row != row || out_col != col || cost >= move_cost(row, col + n)) {
+        col += n;
+        continue;
+      }
+      for (i = col; i < col + n; i += b[i].width ? b[i].width : 1) put_cell(row, i);
+      col += n;
+      continue;
+    }
+
+    n = run_length(b, col, last);
+    if (blank(&b[col]) && n > 1) {
+      cost = seq_cost(n) + attr_cost(ATTR_TEXT);
+      if (cost + seq_cost(n) < n + attr_cost(ATTR_TEXT)) {
+        // Erase a run of blanks without moving, the next write moves past it
+        move_to(row, col);
+        set_attr(ATTR_TEXT);
+        emit(buf, seq(buf, SEQ_ECH, n));
+        for (i = col; i < col + n; i++) f[i] = b[i];
+        col += n;
+        continue;
+      }
+    }
+
+    if (term_rep && b[col].width == 1 && text_len(&b[col]) == 1 && n > 1 && seq_cost(n - 1) < n - 1) {
+      // Repeat the preceding character
+      put_cell(row, col);
+      emit(buf, seq(buf, SEQ_REP, n - 1));
+      for (i = col + 1; i < col + n; i++) f[i] = b[i];
+      out_col += n - 1;
+      if (out_col >= cols) out_col = -1;
+      col += n;
+      continue;
+    }
+
+    put_cell(row, col);
+    col += b[col].width ? b[col].width : 1;
+  }
+}
+
+void term_invalidate() {
+  int i;
+
+  for (i = 0; i < rows * cols; i++) front[i].width = CELL_UNKNOWN;
+  out_row = out_col = out_attr = -1;
+}
+
+void term_resize(int new_rows, int new_cols) {
+ /**
+  * Changes the screen size. Whatever was drawn and still fits is kept, so
+  * the screen can be repainted before everything has been drawn again.
+  */
+  struct cell *old = back;
+  int row, col;
+
+  back = calloc(new_rows * new_cols, sizeof(struct cell));
+  front = realloc(front, new_rows * new_cols * sizeof(struct cell));
+
+  for (row = 0; row < new_rows; row++) {
+    for (col = 0; col < new_cols; col++) {
+      struct cell *c = back + row * new_cols + col;
+      if (old && row < rows && col < cols) *c = old[row * cols + col];
+      if (!old || row >= rows || col >= cols || (c->width == 2 && col + 1 == new_cols)) {
+        memset(c, 0, sizeof(struct cell));
+        c->text[0] = ' ';
+        c->width = 1;
+      }
+    }
+  }
+  free(old);
+
+  rows = new_rows;
+  cols = new_cols;
+  term_invalidate();
+  draw_row = draw_col = cursor_row = cursor_col = 0;
+}
+
+void term_goto(int row, int col) {
+  draw_row = row;
+  draw_col = col;
+}
+
+void term_attr(int attr) {
+  draw_attr = attr;
+}
+
+void term_put(const char *s, int len, int width) {
+ /**
+  * Draws one character at the drawing position. Zero width characters are
+  * combined with the preceding one.
+  */
+  struct cell *c;
+  int n;
+
+  if (draw_row >= rows) return;
+
+  if (width == 0) {
+    if (draw_col == 0) return;
+    c = back + draw_row * cols + draw_col - 1;
+    if (c->width == 0 && draw_col > 1) c--;
+    n = text_len(c);
+    if (n + len <= (int) sizeof(c->text)) memcpy(c->text + n, s, len);
+    return;
+  }
+
+  if (draw_col + width > cols || len > (int) sizeof(c->text)) return;
+
+  c = back + draw_row * cols + draw_col;
+  memset(c->text, 0, sizeof(c->text));
+  memcpy(c->text, s, len);
+  c->width = width;
+  c->attr = draw_attr;
+
+  if (width == 2) {
+    memset(c[1].text, 0, sizeof(c->text));
+    c[1].width = 0;
+    c[1].attr = draw_attr;
+  }
+
+  draw_col += width;
+}
+
+void term_puts(const char *s) {
+  int n, cp;
+
+  while (*s) {
+    n = utf8_decode(s, strlen(s), &cp);
+    term_put(s, n, (unsigned char) *s < 0x80 ? 1 : char_width(cp));
+    s += n;
+  }
+}
+
+void term_clear_eol() {
+  int attr = draw_attr;
+
+  draw_attr = ATTR_TEXT;
+  while (draw_col < cols) term_put(" ", 1, 1);
+  draw_attr = attr;
+}
+
+void term_cursor(int row, int col) {
+  cursor_row = row;
+  cursor_col = col < cols ? col : cols - 1;
+}
+
+void term_cursor_here() {
+  term_cursor(draw_row, draw_col);
+}
+
+int term_flush() {
+ /**
+  * Sends the differences between the drawn screen and the terminal
+  * @return The number of bytes sent
+  */
+  int row;
+
+  out_bytes = 0;
+  for (row = 0; row < rows; row++) flush_row(row);
+  move_to(cursor_row, cursor_col);
+  fflush(stdout);
+
+  term_frame_bytes = out_bytes;
+  return out_bytes;
+}
@@ -0,0 +1,23 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+int term_flush();
+void term_cursor_here();
+void term_cursor(int row,int col);
+void term_clear_eol();
+void term_puts(const char *s);
+void term_put(const char *s,int len,int width);
+void term_attr(int attr);
+void term_goto(int row,int col);
+void term_resize(int new_rows,int new_cols);
+void term_invalidate();
+extern int term_frame_bytes;
+extern int term_rep;
+typedef struct cell cell;
+struct cell {
+  char text[6];              // UTF-8 bytes of the character and any combining marks
+  unsigned char width;       // Screen columns, 0 for the right half of a wide character
+  unsigned char attr;
+};
+enum attributes {ATTR_TEXT, ATTR_SELECT, ATTR_STATUS, ATTR_MATCH, ATTR_KEYWORD};
+typedef enum attributes attributes;
+#define INTERFACE 0
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "trigram.h"
+
+#if INTERFACE
+
+#include <stdint.h>
+
+#define TRIGRAM_CHUNK  512             // Bytes of text per chunk
+#define TRIGRAM_CHUNKS 64              // Chunks an index can tell apart
+#define TRIGRAM_BUCKETS 4096
+
+// Each bucket has a bit for every chunk holding a trigram that hashes to it
+struct trigrams {
+  uint64_t chunks[TRIGRAM_BUCKETS];
+};
+
+#endif
+
+#define LOWER(c)       ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+
+static unsigned bucket(const unsigned char *p) {
+  // Letters are indexed in lowercase so the index serves any-case searches
+  unsigned h = LOWER(p[0]) | LOWER(p[1]) << 8 | LOWER(p[2]) << 16;
+  return (h * 2654435761u) >> 20;
+}
+
+void index_chunk(struct trigrams *index, const char *text, int len, int chunk) {
+ /**
+  * Adds the trigrams starting in the chunk at text, where len counts the
+  * bytes available from there including the two that follow the chunk
+  */
+  const unsigned char *p = (const unsigned char *) text;
+  uint64_t bit = (uint64_t) 1 << chunk;
+  int i;
+
+  if (len > TRIGRAM_CHUNK + 2) len = TRIGRAM_CHUNK + 2;
+  for (i = 0; i + 2 < len; i++) index->chunks[bucket(p + i)] |= bit;
+}
+
+void merge_trigrams(struct trigrams *index, const struct trigrams *from, int first) {
+ /**
+  * Replaces what index has for the chunks from first onwards with from
+  */
+  uint64_t keep = first >= TRIGRAM_CHUNKS ? ~(uint64_t) 0 : ((uint64_t) 1 << first) - 1;
+  int i;
+
+  for (i = 0; i < TRIGRAM_BUCKETS; i++) index->chunks[i] = (index->chunks[i] & keep) | (from->chunks[i] & ~keep);
+}
+
+uint64_t candidate_chunks(const struct trigrams *index, const char *needle, int nlen, int any_case) {
+ /**
+  * Works out which chunks a match can start in. A match starting in chunk c
+  * has each of its trigrams in c or in one of the chunks it reaches into.
+  * @return A bit for every chunk that may hold the start of a match
+  */
+  const unsigned char *p = (const unsigned char *) needle;
+  uint64_t mask, wide, candidates = ~(uint64_t) 0;
+  int reach = (nlen - 3 + TRIGRAM_CHUNK - 1) / TRIGRAM_CHUNK;
+  int i, j;
+
+  for (i = 0; i + 2 < nlen && candidates; i++) {
+    // Multibyte characters fold to other bytes when ignoring case
+    if (any_case && ((p[i] | p[i + 1] | p[i + 2]) & 0x80)) continue;
+    mask = index->chunks[bucket(p + i)];
+    wide = mask;
+    for (j = 1; j <= reach && j < TRIGRAM_CHUNKS; j++) wide |= mask >> j;
+    candidates &= wide;
+  }
+  return candidates;
+}
@@ -0,0 +1,14 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+#include <stdint.h>
+typedef struct trigrams trigrams;
+uint64_t candidate_chunks(const struct trigrams *index,const char *needle,int nlen,int any_case);
+void merge_trigrams(struct trigrams *index,const struct trigrams *from,int first);
+void index_chunk(struct trigrams *index,const char *text,int len,int chunk);
+#define TRIGRAM_BUCKETS 4096
+struct trigrams {
+  uint64_t chunks[TRIGRAM_BUCKETS];
+};
+#define TRIGRAM_CHUNKS 64              // Chunks an index can tell apart
+#define TRIGRAM_CHUNK  512             // Bytes of text per chunk
+#define INTERFACE 0
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "unicode.h"
+#include "unicode_tables.h"
+
+#if INTERFACE
+
+#define utf8_continuation(ch) (((ch) & 0b11000000) == 0b10000000)
+
+#endif
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+int utf8_length(int ch) {
+  if ((ch & 0b10000000) == 0b00000000) return 1;
+  if ((ch & 0b11100000) == 0b11000000) return 2;
+  if ((ch & 0b11110000) == 0b11100000) return 3;
+  if ((ch & 0b11111000) == 0b11110000) return 4;
+  return 1;
+}
+
+int utf8_decode(const char *s, int len, int *cp) {
+ /**
+  * Decodes the character at s, reading at most len bytes
+  * @return The number of bytes consumed. Invalid sequences consume one byte
+  *         and decode to U+FFFD.
+  */
+  const unsigned char *p = (const unsigned char *) s;
+  int n = utf8_length(p[0]);
+  int i, c;
+
+  if (n == 1) {
+    *cp = p[0] < 0x80 ? p[0] : 0xFFFD;
+    return 1;
+  }
+
+  if (n > len) goto invalid;
+
+  c = p[0] & (0xFF >> (n + 1));
+  for (i = 1; i < n; i++) {
+    if (!utf8_continuation(p[i])) goto invalid;
+    c = (c << 6) | (p[i] & 0b00111111);
+  }
+
+  *cp = c;
+  return n;
+
+invalid:
+  *cp = 0xFFFD;
+  return 1;
+}
+
+int utf8_encode(int cp, char *buf) {
+  if (cp < 0x80) {
+    buf[0] = cp;
+    return 1;
+  } else if (cp < 0x800) {
+    buf[0] = 0b11000000 | (cp >> 6);
+    buf[1] = 0b10000000 | (cp & 0b00111111);
+    return 2;
+  } else if (cp < 0x10000) {
+    buf[0] = 0b11100000 | (cp >> 12);
+    buf[1] = 0b10000000 | ((cp >> 6) & 0b00111111);
+    buf[2] = 0b10000000 | (cp & 0b00111111);
+    return 3;
+  } else {
+    buf[0] = 0b11110000 | (cp >> 18);
+    buf[1] = 0b10000000 | ((cp >> 12) & 0b00111111);
+    buf[2] = 0b10000000 | ((cp >> 6) & 0b00111111);
+    buf[3] = 0b10000000 | (cp & 0b00111111);
+    return 4;
+  }
+}
+
+int char_width(int cp) {
+  if (cp < 0x80) return 1;
+  if (cp >= 0x110000) return 1;
+  return (width_blocks[width_index[cp >> 8]][(cp & 0xFF) >> 2] >> (2 * (cp & 3))) & 3;
+}
+
+int fold_case(int cp) {
+ /**
+  * @return The lowercase form of cp, if it is encoded in as many bytes
+  */
+  if (cp < 0x80) return cp >= 'A' && cp <= 'Z' ? cp + 32 : cp;
+  if (cp >= 0x110000) return cp;
+  return cp + fold_blocks[fold_index[cp >> 8]][cp & 0xFF];
+}
+
+static int plain_ascii(const char *s) {
+  uint64_t a, b;
+
+  // Eight bytes at a time: no high bits set and no tabs
+  memcpy(&a, s, 8);
+  memcpy(&b, s + 8, 8);
+  if ((a | b) & HIGHS) return 0;
+  a ^= ONES * '\t';
+  b ^= ONES * '\t';
+  return !(((a - ONES) | (b - ONES)) & HIGHS);
+}
+
+int text_width(const char *s, int len, int col, int tabsize) {
+ /**
+  * Computes the screen column reached by displaying len bytes of s starting
+  * at screen column col
+  */
+  const char *end = s + len;
+  int n, cp;
+
+  while (s < end) {
+    if (end - s >= 16 && plain_ascii(s)) {
+      s += 16;
+      col += 16;
+      continue;
+    }
+
+    if (*s == '\t') {
+      col += tabsize - col % tabsize;
+      s++;
+    } else if ((unsigned char) *s < 0x80) {
+      col++;
+      s++;
+    } else {
+      n = utf8_decode(s, end - s, &cp);
+      col += char_width(cp);
+      s += n;
+    }
+  }
+
+  return col;
+}
+
+int text_offset(const char *s, int len, int col, int target, int tabsize, int *reached) {
+ /**
+  * Finds the first character of s starting at or after screen column target,
+  * where s itself starts at screen column col
+  * @return The byte offset of that character, with its column in *reached
+  */
+  const char *p = s;
+  const char *end = s + len;
+  int n, cp, next;
+
+  while (p < end && col < target) {
+    if (end - p >= 16 && col + 16 <= target && plain_ascii(p)) {
+      p += 16;
+      col += 16;
+      continue;
+    }
+
+    n = 1;
+    if (*p == '\t') {
+      next = col + tabsize - col % tabsize;
+    } else if ((unsigned char) *p < 0x80) {
+      next = col + 1;
+    } else {
+      n = utf8_decode(p, end - p, &cp);
+      next = col + char_width(cp);
+    }
+
+    col = next;
+    p += n;
+  }
+
+  *reached = col;
+  return p - s;
+}
+
+int text_fit(const char *s, int len, int maxcol, int tabsize, int *width) {
+ /**
+  * Measures how much of s fits on a screen row maxcol columns wide. Tabs are
+  * cut short at the edge and wide characters that do not fit are left over.
+  * @return The number of bytes that fit, with the columns used in *width
+  */
+  const char *p = s;
+  const char *end = s + len;
+  int n, cp, w;
+  int col = 0;
+
+  while (p < end && col < maxcol) {
+    if (end - p >= 16 && col + 16 <= maxcol && plain_ascii(p)) {
+      p += 16;
+      col += 16;
+      continue;
+    }
+
+    if (*p == '\t') {
+      col += tabsize - col % tabsize;
+      if (col > maxcol) col = maxcol;
+      p++;
+    } else if ((unsigned char) *p < 0x80) {
+      col++;
+      p++;
+    } else {
+      n = utf8_decode(p, end - p, &cp);
+      w = char_width(cp);
+      if (col + w > maxcol) {
+        col = maxcol;
+        break;
+      }
+      col += w;
+      p += n;
+    }
+  }
+
+  *width = col;
+  return p - s;
+}
@@ -0,0 +1,12 @@
+/* This file was automatically generated.  Do not edit! */
+#undef INTERFACE
+int text_fit(const char *s,int len,int maxcol,int tabsize,int *width);
+int text_offset(const char *s,int len,int col,int target,int tabsize,int *reached);
+int text_width(const char *s,int len,int col,int tabsize);
+int fold_case(int cp);
+int char_width(int cp);
+int utf8_encode(int cp,char *buf);
+int utf8_decode(const char *s,int len,int *cp);
+int utf8_length(int ch);
+#define utf8_continuation(ch) (((ch) & 0b11000000) == 0b10000000)
+#define INTERFACE 0
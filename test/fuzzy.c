@@ -0,0 +1,56 @@
+// Checks fuzzy scoring, including queries that start with whitespace, and
+// that the kept results are the best ones in order
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/fuzzy.h"
+
+static int check(const char *what, int ok) {
+  if (!ok) printf("fuzzy: %s failed\n", what);
+  return !ok;
+}
+
+static int score(const char *line, const char *query) {
+  return fuzzy_score(line, strlen(line), query, strlen(query));
+}
+
+int main() {
+  struct best best;
+  int scores[200];
+  int failed = 0;
+  int i, n, worst;
+
+  failed |= check("missing character", score("abc", "abd") < 0);
+  failed |= check("order", score("cba", "abc") < 0);
+  failed |= check("any case", score("Hello", "hELLO") >= 0);
+  failed |= check("word start", score("get_value", "gv") > score("gravy", "gv"));
+  failed |= check("run", score("xabcx", "abc") > score("xaxbxc", "abc"));
+
+  // A query starting with whitespace matches inside the indent, where the
+  // first character is the start of the line: two matches with the start
+  // bonus and a run, on a line of four bytes
+  failed |= check("space query", score(" foo", " f") == (2 * 16 + 2 * 10 + 4) * 64 + 63 - 4);
+  failed |= check("tab query", score("\tbar", "\tb") == score(" foo", " f"));
+
+  srand(1);
+  memset(&best, 0, sizeof(best));
+  n = sizeof(scores) / sizeof(*scores);
+  for (i = 0; i < n; i++) {
+    scores[i] = rand() % 50;
+    keep_best(&best, scores[i], i);
+  }
+  sort_best(&best);
+  failed |= check("count", best.count == FUZZY_BEST);
+  for (i = 1; i < best.count; i++) {
+    failed |= check("order of results", best.hits[i - 1].score > best.hits[i].score ||
+      (best.hits[i - 1].score == best.hits[i].score && best.hits[i - 1].pos < best.hits[i].pos));
+  }
+  // Nothing left out beats the worst result kept
+  worst = best.hits[best.count - 1].score;
+  for (i = 0, n = 0; i < (int) (sizeof(scores) / sizeof(*scores)); i++) n += scores[i] > worst;
+  failed |= check("best kept", n < FUZZY_BEST);
+
+  return failed;
+}
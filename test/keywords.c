@@ -0,0 +1,70 @@
+// Checks find_keywords against marking every occurrence of every keyword
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/keywords.h"
+
+#define MAX_TEXT       200
+
+int main() {
+  static const char alphabet[] = "abc,";
+  char list[64], text[MAX_TEXT];
+  char covered[MAX_TEXT];
+  struct span spans[MAX_TEXT], want[MAX_TEXT];
+  struct keywords *kw;
+  const char *p, *end;
+  int failed = 0;
+  int iter, len, n, count, got, i, k;
+
+  srand(1);
+  for (iter = 0; iter < 20000 && !failed; iter++) {
+    n = 1 + rand() % (sizeof(list) - 1);
+    for (i = 0; i < n; i++) list[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    list[n] = 0;
+    len = rand() % MAX_TEXT;
+    for (i = 0; i < len; i++) text[i] = alphabet[rand() % 3];
+
+    // Every byte inside an occurrence of a keyword is covered
+    memset(covered, 0, len);
+    for (p = list; *p; p = *end ? end + 1 : end) {
+      end = strchr(p, ',');
+      if (!end) end = p + strlen(p);
+      n = end - p;
+      for (i = 0; n && i + n <= len; i++) {
+        if (!memcmp(text + i, p, n)) memset(covered + i, 1, n);
+      }
+    }
+
+    // Spans are the runs of covered bytes, since touching ones are joined
+    count = 0;
+    for (i = 0; i < len; i = k) {
+      for (k = i; k < len && covered[k] == covered[i]; k++);
+      if (covered[i]) {
+        want[count].start = i;
+        want[count].end = k;
+        count++;
+      }
+    }
+
+    kw = compile_keywords(list);
+    got = kw ? find_keywords(kw, text, len, spans, MAX_TEXT) : 0;
+    if (!kw && strspn(list, ",") != strlen(list)) {
+      printf("keywords: \"%s\" did not compile\n", list);
+      return 1;
+    }
+
+    if (got != count || memcmp(spans, want, count * sizeof(struct span))) {
+      printf("keywords: \"%s\" in \"%.*s\" gave %d spans, not %d\n", list, len, text, got, count);
+      failed = 1;
+    }
+    if (kw) {
+      free(kw->next);
+      free(kw->length);
+      free(kw);
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,230 @@
+// Checks regex_search against a backtracking matcher on random patterns,
+// which are built as trees and written out for regex_compile
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/regex.h"
+
+enum {LEAF, CAT, ALT, STAR, PLUS, QUEST, BOL, EOL, EMPTY};
+
+struct node {
+  int type;
+  int a, b;                  // Operands, or the leaf for LEAF
+  int greedy;
+};
+
+static const char *leaves[] = {
+  "a", "b", "c", "0", " ", "\\n", ".", "[ab]", "[^a]", "[a-c]", "\\d", "\\w", "\\s", "\\D", "\\W", "\\S", "[\\d ]"
+};
+
+#define LEAVES         (int) (sizeof(leaves) / sizeof(*leaves))
+#define MAX_NODES      256
+
+static struct node nodes[MAX_NODES];
+static int num_nodes;
+static char pattern[1024];
+static const char *text;
+static int len;
+
+static int in_leaf(int leaf, int c) {
+  int digit = c >= '0' && c <= '9';
+  int word = digit || c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  int space = c == ' ' || (c >= '\t' && c <= '\r');
+
+  switch (leaf) {
+    case 0: return c == 'a';
+    case 1: return c == 'b';
+    case 2: return c == 'c';
+    case 3: return c == '0';
+    case 4: return c == ' ';
+    case 5: return c == '\n';
+    case 6: return c != '\n';
+    case 7: return c == 'a' || c == 'b';
+    case 8: return c != 'a';
+    case 9: return c >= 'a' && c <= 'c';
+    case 10: return digit;
+    case 11: return word;
+    case 12: return space;
+    case 13: return !digit;
+    case 14: return !word;
+    case 15: return !space;
+    default: return digit || c == ' ';
+  }
+}
+
+static int add(int type, int a, int b, int greedy) {
+  nodes[num_nodes].type = type;
+  nodes[num_nodes].a = a;
+  nodes[num_nodes].b = b;
+  nodes[num_nodes].greedy = greedy;
+  return num_nodes++;
+}
+
+static int nullable(int n) {
+  struct node *node = &nodes[n];
+
+  switch (node->type) {
+    case LEAF: return 0;
+    case PLUS: return nullable(node->a);
+    case CAT: return nullable(node->a) && nullable(node->b);
+    case ALT: return nullable(node->a) || nullable(node->b);
+    default: return 1;
+  }
+}
+
+static int generate_alt(int depth);
+
+static int generate_repeat(int depth) {
+  // Only atoms that read something are repeated, so that backtracking ends
+  int n, r = rand() % 16;
+  int type, greedy;
+
+  if (r == 0) {
+    strcat(pattern, "^");
+    return add(BOL, -1, -1, 0);
+  } else if (r == 1) {
+    strcat(pattern, "$");
+    return add(EOL, -1, -1, 0);
+  } else if (r < 5 && depth > 0 && num_nodes < MAX_NODES / 2) {
+    strcat(pattern, rand() % 2 ? "(" : "(?:");
+    n = generate_alt(depth - 1);
+    strcat(pattern, ")");
+  } else {
+    r = rand() % LEAVES;
+    strcat(pattern, leaves[r]);
+    n = add(LEAF, r, -1, 0);
+  }
+
+  if (nullable(n) || rand() % 2) return n;
+  r = rand() % 3;
+  type = r == 0 ? STAR : r == 1 ? PLUS : QUEST;
+  strcat(pattern, r == 0 ? "*" : r == 1 ? "+" : "?");
+  greedy = rand() % 3 != 0;
+  if (!greedy) strcat(pattern, "?");
+  // One or more is the atom followed by the same atom repeated
+  return add(type, n, type == PLUS ? add(STAR, n, -1, greedy) : -1, greedy);
+}
+
+static int generate_concat(int depth) {
+  int n = -1;
+  int count = rand() % 4;
+
+  if (count == 0) return add(EMPTY, -1, -1, 0);
+  while (count--) n = n < 0 ? generate_repeat(depth) : add(CAT, n, generate_repeat(depth), 0);
+  return n;
+}
+
+static int generate_alt(int depth) {
+  int n = generate_concat(depth);
+
+  while (rand() % 3 == 0) {
+    strcat(pattern, "|");
+    n = add(ALT, n, generate_concat(depth), 0);
+  }
+  return n;
+}
+
+// What is left to match after a node, innermost first
+struct cont {
+  int node;
+  const struct cont *next;
+};
+
+static int match(int n, int i, const struct cont *k);
+
+static int done(int i, const struct cont *k) {
+  return k ? match(k->node, i, k->next) : i;
+}
+
+static int match(int n, int i, const struct cont *k) {
+ /**
+  * Matches node n at i and then k, preferring what the pattern prefers
+  * @return Where the match ends, or -1
+  */
+  struct node *node = &nodes[n];
+  struct cont more = {n, k};
+  int r;
+
+  switch (node->type) {
+    case LEAF:
+      return i < len && in_leaf(node->a, (unsigned char) text[i]) ? done(i + 1, k) : -1;
+    case CAT:
+      more.node = node->b;
+      return match(node->a, i, &more);
+    case ALT:
+      r = match(node->a, i, k);
+      return r >= 0 ? r : match(node->b, i, k);
+    case STAR:
+      if (!node->greedy) {
+        r = done(i, k);
+        return r >= 0 ? r : match(node->a, i, &more);
+      }
+      r = match(node->a, i, &more);
+      return r >= 0 ? r : done(i, k);
+    case PLUS:
+      more.node = node->b;
+      return match(node->a, i, &more);
+    case QUEST:
+      if (!node->greedy) {
+        r = done(i, k);
+        return r >= 0 ? r : match(node->a, i, k);
+      }
+      r = match(node->a, i, k);
+      return r >= 0 ? r : done(i, k);
+    case BOL:
+      return i == 0 || text[i - 1] == '\n' ? done(i, k) : -1;
+    case EOL:
+      return i == len || text[i] == '\n' ? done(i, k) : -1;
+    default:
+      return done(i, k);
+  }
+}
+
+int main() {
+  static const char alphabet[] = "ab c0\n1";
+  char buf[24];
+  struct regex *re;
+  int failed = 0;
+  int iter, root, pos, start, end, got, got_end, want, want_end, i;
+
+  srand(1);
+  for (iter = 0; iter < 20000 && !failed; iter++) {
+    num_nodes = 0;
+    pattern[0] = 0;
+    root = generate_alt(2);
+    re = regex_compile(pattern);
+    if (!re) {
+      printf("regex: /%s/ did not compile\n", pattern);
+      return 1;
+    }
+
+    for (i = 0; i < 20 && !failed; i++) {
+      len = rand() % sizeof(buf);
+      for (pos = 0; pos < len; pos++) buf[pos] = alphabet[rand() % (sizeof(alphabet) - 1)];
+      text = buf;
+      pos = rand() % (len + 1);
+
+      want = want_end = -1;
+      for (start = pos; start <= len && want < 0; start++) {
+        end = match(root, start, NULL);
+        if (end >= 0) {
+          want = start;
+          want_end = end;
+        }
+      }
+      got_end = -1;
+      got = regex_search(re, text, len, pos, &got_end);
+      if (got < 0) got_end = -1;
+
+      if (got != want || got_end != want_end) {
+        printf("regex: /%s/ from %d in \"%.*s\" gave %d-%d, not %d-%d\n", pattern, pos, len, text, got, got_end, want, want_end);
+        failed = 1;
+      }
+    }
+    regex_free(re);
+  }
+
+  return failed;
+}
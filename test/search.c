@@ -0,0 +1,82 @@
+// Checks the substring searches against a byte by byte search
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/search.h"
+
+#define LOWER(c)       ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+
+static int same(const char *a, const char *b, int len, int any_case) {
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (any_case ? LOWER(a[i]) != LOWER(b[i]) : a[i] != b[i]) return 0;
+  }
+  return 1;
+}
+
+static int naive(const char *text, int len, const char *needle, int nlen, int any_case, int last) {
+  int i;
+
+  if (last) {
+    for (i = len - nlen; i >= 0; i--) {
+      if (same(text + i, needle, nlen, any_case)) return i;
+    }
+  } else {
+    for (i = 0; i + nlen <= len; i++) {
+      if (same(text + i, needle, nlen, any_case)) return i;
+    }
+  }
+  return -1;
+}
+
+static void random_text(char *buf, int len, const char *alphabet) {
+  int n = strlen(alphabet);
+  int i;
+
+  for (i = 0; i < len; i++) buf[i] = alphabet[rand() % n];
+}
+
+int main() {
+  // '@' and '[' differ from letters only in the bit that folds case
+  static const char *alphabets[] = {"ab", "aAbB@[`{", "abcdefghij\n ", "aaaaaaab"};
+  char text[600], needle[80];
+  int failed = 0;
+  int iter, len, nlen, any_case, last, got, want;
+
+  srand(1);
+  for (iter = 0; iter < 200000 && !failed; iter++) {
+    const char *alphabet = alphabets[rand() % 4];
+    len = rand() % (rand() % 8 ? 64 : sizeof(text));
+    nlen = 1 + rand() % (rand() % 4 ? 6 : sizeof(needle));
+    random_text(text, len, alphabet);
+
+    // Needles are often taken from the text, so that there is a match
+    if (len >= nlen && rand() % 2) {
+      memcpy(needle, text + rand() % (len - nlen + 1), nlen);
+    } else {
+      random_text(needle, nlen, alphabet);
+    }
+
+    any_case = rand() % 2;
+    last = rand() % 2;
+    if (last) {
+      got = search_last(text, len, needle, nlen, any_case);
+    } else if (any_case) {
+      got = search_any_case(text, len, needle, nlen);
+    } else {
+      got = search_text(text, len, needle, nlen);
+    }
+    want = naive(text, len, needle, nlen, any_case, last);
+
+    if (got != want) {
+      printf("search: %s%s search for \"%.*s\" in \"%.*s\" gave %d, not %d\n", last ? "backward " : "", any_case ? "any case" : "exact",
+        nlen, needle, len, text, got, want);
+      failed = 1;
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,90 @@
+// Checks that snapshots keep their text through random edits of the live
+// buffer, and that they copy no more than the edits remove
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/snapshot.h"
+
+#define MAX_TEXT       4096
+#define SNAPSHOTS      4
+
+static char live[MAX_TEXT + 1];
+
+static void edit(int pos, int len, const char *text, int n) {
+  // Replaces the len bytes at pos with n others, as the editor does
+  preserve_snapshots(live, pos, len, n);
+  memmove(live + pos + n, live + pos + len, strlen(live + pos + len) + 1);
+  memcpy(live + pos, text, n);
+  resume_snapshots(live);
+}
+
+static int copied(struct snapshot *snap) {
+  int i, bytes = 0;
+
+  for (i = 0; i < snap->num_pieces; i++) {
+    if (snap->pieces[i].copy) bytes += snap->pieces[i].length;
+  }
+  return bytes;
+}
+
+int main() {
+  struct snapshot *snaps[SNAPSHOTS];
+  char *expected[SNAPSHOTS];
+  int removed[SNAPSHOTS];
+  char text[64], buf[MAX_TEXT];
+  int failed = 0;
+  int iter, step, length, pos, len, n, got, s, i, from;
+
+  srand(1);
+  for (iter = 0; iter < 2000 && !failed; iter++) {
+    length = rand() % 1000;
+    for (i = 0; i < length; i++) live[i] = 'a' + rand() % 26;
+    live[length] = 0;
+    memset(snaps, 0, sizeof(snaps));
+
+    for (step = 0; step < 100 && !failed; step++) {
+      // Now and then another snapshot is taken
+      s = rand() % SNAPSHOTS;
+      if (!snaps[s] || rand() % 8 == 0) {
+        release_snapshot(snaps[s]);
+        if (snaps[s]) free(expected[s]);
+        length = strlen(live);
+        snaps[s] = take_snapshot(live, length, step);
+        expected[s] = strdup(live);
+        removed[s] = 0;
+      }
+
+      length = strlen(live);
+      pos = rand() % (length + 1);
+      len = rand() % 3 == 0 ? rand() % (length - pos + 1) : 0;
+      n = rand() % 3 == 0 ? 0 : rand() % sizeof(text);
+      if (length - len + n > MAX_TEXT) n = 0;
+      for (i = 0; i < n; i++) text[i] = 'A' + rand() % 26;
+      edit(pos, len, text, n);
+      for (s = 0; s < SNAPSHOTS; s++) removed[s] += len;
+
+      for (s = 0; s < SNAPSHOTS && !failed; s++) {
+        if (!snaps[s]) continue;
+        from = rand() % (snaps[s]->length + 1);
+        got = read_snapshot(snaps[s], from, buf, sizeof(buf));
+        if (got != snaps[s]->length - from || memcmp(buf, expected[s] + from, got)) {
+          printf("snapshot: text changed after replacing %d bytes at %d with %d\n", len, pos, n);
+          failed = 1;
+        } else if (copied(snaps[s]) > removed[s]) {
+          printf("snapshot: %d bytes copied where %d were removed\n", copied(snaps[s]), removed[s]);
+          failed = 1;
+        }
+      }
+    }
+
+    for (s = 0; s < SNAPSHOTS; s++) {
+      if (!snaps[s]) continue;
+      release_snapshot(snaps[s]);
+      free(expected[s]);
+    }
+  }
+
+  return failed;
+}
@@ -0,0 +1,88 @@
+// Checks the symbol index against inputs that have crashed the parser and
+// against a full parse after every incremental one
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/symbols.h"
+
+static const char *crashers[] = {
+  "= Title",
+  "= 1;",
+  "int f(void) {}\n= 1;",
+  "extern",
+  "//c\nextern",
+  NULL
+};
+
+static const char *source =
+  "#define LIMIT 10\n"
+  "typedef struct point point;\n"
+  "static int count;\n"
+  "int add(int a, int b);\n"
+  "int add(int a, int b) {\n"
+  "  return a + b;\n"
+  "}\n"
+  "static void reset(void) {\n"
+  "  count = 0;\n"
+  "}\n"
+  "int main(void) {\n"
+  "  return add(1, 2);\n"
+  "}\n";
+
+static struct symbols full, part, more;
+
+static int check(const char *what, int ok) {
+  if (!ok) printf("symbols: %s failed\n", what);
+  return !ok;
+}
+
+static int reparse_matches(const char *text, int pos) {
+  // Symbols kept up to pos and parsed again from there must be the same as
+  // those of a full parse
+  int from, i;
+
+  parse_symbols(&part, text, 0);
+  from = keep_symbols(&part, pos);
+  more.count = 0;
+  parse_symbols(&more, text + from, from);
+  append_symbols(&part, &more);
+
+  full.count = 0;
+  parse_symbols(&full, text, 0);
+  if (part.count != full.count) return 0;
+  for (i = 0; i < full.count; i++) {
+    if (memcmp(&part.list[i], &full.list[i], sizeof(struct symbol))) return 0;
+  }
+  return 1;
+}
+
+int main() {
+  struct symbol *s;
+  int failed = 0;
+  int i, pos;
+
+  for (i = 0; crashers[i]; i++) {
+    full.count = 0;
+    parse_symbols(&full, crashers[i], 0);
+  }
+
+  full.count = 0;
+  failed |= check("parse", parse_symbols(&full, source, 0) == 0);
+  s = find_symbol(&full, source, "add");
+  failed |= check("definition over prototype", s && s->defined && !strncmp(source + s->pos - 4, "int add(int a, int b) {", 23));
+  failed |= check("static function", find_symbol(&full, source, "reset") != NULL);
+  failed |= check("macro", find_symbol(&full, source, "LIMIT") != NULL);
+  failed |= check("missing name", find_symbol(&full, source, "nothing") == NULL);
+
+  for (pos = 0; pos <= (int) strlen(source); pos++) {
+    part.count = 0;
+    if (!reparse_matches(source, pos)) {
+      printf("symbols: reparse from %d differs from a full parse\n", pos);
+      failed = 1;
+      break;
+    }
+  }
+
+  return failed;
+}
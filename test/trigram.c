@@ -0,0 +1,62 @@
+// Checks that candidate_chunks never rules out a chunk where a match starts
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/trigram.h"
+
+#define MAX_TEXT       (TRIGRAM_CHUNK * TRIGRAM_CHUNKS)
+#define LOWER(c)       ((c) >= 'A' && (c) <= 'Z' ? (c) + 32 : (c))
+
+static struct trigrams table;
+static char text[MAX_TEXT];
+
+static int same(const char *a, const char *b, int len, int any_case) {
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (any_case ? LOWER(a[i]) != LOWER(b[i]) : a[i] != b[i]) return 0;
+  }
+  return 1;
+}
+
+int main() {
+  static const char alphabet[] = "abcdAB \n";
+  char needle[1200];
+  uint64_t candidates;
+  int failed = 0;
+  int iter, len, nlen, any_case, chunk, at, i;
+
+  srand(1);
+  for (iter = 0; iter < 100 && !failed; iter++) {
+    len = rand() % MAX_TEXT;
+    for (i = 0; i < len; i++) text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    memset(&table, 0, sizeof(table));
+    for (chunk = 0; chunk * TRIGRAM_CHUNK < len; chunk++) {
+      index_chunk(&table, text + chunk * TRIGRAM_CHUNK, len - chunk * TRIGRAM_CHUNK, chunk);
+    }
+
+    for (i = 0; i < 50 && !failed && len; i++) {
+      nlen = 1 + rand() % (rand() % 4 ? 8 : sizeof(needle));
+      if (nlen > len) nlen = len;
+      memcpy(needle, text + rand() % (len - nlen + 1), nlen);
+      any_case = rand() % 2;
+      // A needle in the other case only matches ignoring case
+      if (any_case) needle[rand() % nlen] ^= 0x20;
+      candidates = candidate_chunks(&table, needle, nlen, any_case);
+
+      for (chunk = 0; chunk * TRIGRAM_CHUNK + nlen <= len && !failed; chunk++) {
+        for (at = chunk * TRIGRAM_CHUNK; at < (chunk + 1) * TRIGRAM_CHUNK && at + nlen <= len; at++) {
+          if (same(text + at, needle, nlen, any_case) && !(candidates >> chunk & 1)) {
+            printf("trigram: match of %d bytes at %d is in chunk %d, which was ruled out\n", nlen, at, chunk);
+            failed = 1;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  return failed;
+}